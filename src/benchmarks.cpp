@@ -0,0 +1,358 @@
+#include <algorithm>
+#include <chrono>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "dims.hpp"
+#include "units.hpp"
+
+/*
+ * Micro-benchmarks comparing the same kernels written with raw doubles,
+ * with dims::quantity and with units::unit. The wrappers are supposed to
+ * have no overhead so the three columns should match.
+ *
+ *     benchmarks [n] [reps]   time the kernels and report ns/element
+ *     benchmarks --asm        dump the generated assembly of each kernel
+ *
+ * The assembly dump is produced with objdump and has the addresses removed
+ * so that dumps from two builds (or two compilers) can be diffed directly.
+ */
+
+using namespace std;
+using namespace dims;
+using namespace units;
+
+#if defined(__GNUC__)
+#define BENCH_NOINLINE __attribute__((noinline))
+#else
+#define BENCH_NOINLINE
+#endif
+
+using G_dim = IntDim<-1,3,-2>;
+
+namespace bench {
+
+	/*
+	 * y = a*x + y
+	 */
+
+	BENCH_NOINLINE void axpy_raw(size_t n, double a, const double* x, double* y) {
+		for(size_t i=0; i<n; ++i)
+			y[i] += a*x[i];
+	}
+
+	BENCH_NOINLINE void axpy_quantity(size_t n, dims::time_t<> a, const velocity_t<>* x, length_t<>* y) {
+		for(size_t i=0; i<n; ++i)
+			y[i] += a*x[i];
+	}
+
+	BENCH_NOINLINE void axpy_unit(size_t n, unit<dims::time,si_system> a, const unit<velocity,si_system>* x, unit<length,si_system>* y) {
+		for(size_t i=0; i<n; ++i)
+			y[i] += a*x[i];
+	}
+
+	/*
+	 * work = sum F.d
+	 */
+
+	BENCH_NOINLINE double dot_raw(size_t n, const double* f, const double* d) {
+		double out = 0.0;
+		for(size_t i=0; i<n; ++i)
+			out += f[i]*d[i];
+		return out;
+	}
+
+	BENCH_NOINLINE work_t<> dot_quantity(size_t n, const force_t<>* f, const length_t<>* d) {
+		work_t<> out(0.0);
+		for(size_t i=0; i<n; ++i)
+			out += f[i]*d[i];
+		return out;
+	}
+
+	BENCH_NOINLINE unit<work,si_system> dot_unit(size_t n, const unit<force,si_system>* f, const unit<length,si_system>* d) {
+		unit<work,si_system> out(0.0);
+		for(size_t i=0; i<n; ++i)
+			out += f[i]*d[i];
+		return out;
+	}
+
+	/*
+	 * Softened gravitational forces, O(n^2). The positions are stored as
+	 * separate x, y, z arrays so all three variants have the same layout.
+	 */
+
+	BENCH_NOINLINE void nbody_raw(size_t n, double G, double eps2, const double* m,
+	                              const double* x, const double* y, const double* z,
+	                              double* fx, double* fy, double* fz) {
+		for(size_t i=0; i<n; ++i) {
+			double ax = 0.0, ay = 0.0, az = 0.0;
+			for(size_t j=0; j<n; ++j) {
+				const double dx = x[j]-x[i], dy = y[j]-y[i], dz = z[j]-z[i];
+				const double r2 = dx*dx + dy*dy + dz*dz + eps2;
+				const double s = G*m[i]*m[j]/(r2*sqrt(r2));
+				ax += s*dx;
+				ay += s*dy;
+				az += s*dz;
+			}
+			fx[i] = ax;
+			fy[i] = ay;
+			fz[i] = az;
+		}
+	}
+
+	BENCH_NOINLINE void nbody_quantity(size_t n, quantity<G_dim> G, area_t<> eps2, const mass_t<>* m,
+	                                   const length_t<>* x, const length_t<>* y, const length_t<>* z,
+	                                   force_t<>* fx, force_t<>* fy, force_t<>* fz) {
+		for(size_t i=0; i<n; ++i) {
+			force_t<> ax(0.0), ay(0.0), az(0.0);
+			for(size_t j=0; j<n; ++j) {
+				const length_t<> dx = x[j]-x[i], dy = y[j]-y[i], dz = z[j]-z[i];
+				const area_t<> r2 = dx*dx + dy*dy + dz*dz + eps2;
+				const auto s = G*m[i]*m[j]/(r2*sqrt(r2));
+				ax += s*dx;
+				ay += s*dy;
+				az += s*dz;
+			}
+			fx[i] = ax;
+			fy[i] = ay;
+			fz[i] = az;
+		}
+	}
+
+	BENCH_NOINLINE void nbody_unit(size_t n, unit<G_dim,si_system> G, unit<area,si_system> eps2, const unit<mass,si_system>* m,
+	                               const unit<length,si_system>* x, const unit<length,si_system>* y, const unit<length,si_system>* z,
+	                               unit<force,si_system>* fx, unit<force,si_system>* fy, unit<force,si_system>* fz) {
+		for(size_t i=0; i<n; ++i) {
+			unit<force,si_system> ax(0.0), ay(0.0), az(0.0);
+			for(size_t j=0; j<n; ++j) {
+				const unit<length,si_system> dx = x[j]-x[i], dy = y[j]-y[i], dz = z[j]-z[i];
+				const unit<area,si_system> r2 = dx*dx + dy*dy + dz*dz + eps2;
+				const auto s = G*m[i]*m[j]/(r2*sqrt(r2));
+				ax += s*dx;
+				ay += s*dy;
+				az += s*dz;
+			}
+			fx[i] = ax;
+			fy[i] = ay;
+			fz[i] = az;
+		}
+	}
+
+	/*
+	 * Conversion chain cm^2 -> m^2 -> ft^2. The raw and quantity versions use
+	 * the combined factor directly, the unit version goes through the
+	 * converting constructors.
+	 */
+
+	BENCH_NOINLINE void convert_raw(size_t n, double factor, const double* in, double* out) {
+		for(size_t i=0; i<n; ++i)
+			out[i] = in[i]*factor;
+	}
+
+	BENCH_NOINLINE void convert_quantity(size_t n, number_t<> factor, const area_t<>* in, area_t<>* out) {
+		for(size_t i=0; i<n; ++i)
+			out[i] = in[i]*factor;
+	}
+
+	BENCH_NOINLINE void convert_unit(size_t n, const unit<area,cgs_system>* in, unit<area,imperial_system>* out) {
+		for(size_t i=0; i<n; ++i)
+			out[i] = unit<area,imperial_system>(unit<area,si_system>(in[i]));
+	}
+
+}; // namespace bench
+
+/*
+ * Timing helpers
+ */
+
+volatile double sink; // stops results being optimised away
+
+template<class F>
+double time_ns(size_t reps, F f) {
+	double best = 1e300;
+	for(size_t r=0; r<reps; ++r) {
+		auto start = chrono::steady_clock::now();
+		f();
+		auto stop = chrono::steady_clock::now();
+		best = min(best,chrono::duration<double,nano>(stop-start).count());
+	}
+	return best;
+}
+
+void report(const string& name, double elements, double raw, double qty, double unt) {
+	cout << left << setw(12) << name << right << fixed << setprecision(3)
+		 << setw(14) << raw/elements
+		 << setw(14) << qty/elements
+		 << setw(14) << unt/elements
+		 << setw(12) << setprecision(2) << qty/raw
+		 << setw(12) << unt/raw << endl;
+}
+
+// path of this executable, argv[0] need not be one (e.g. when run from $PATH)
+string self_path(const char* argv0) {
+	char buf[4096];
+	const ssize_t len = readlink("/proc/self/exe",buf,sizeof(buf)-1);
+	return len>0 ? string(buf,len) : string(argv0);
+}
+
+// s as a single shell word, an embedded ' becomes '\''
+string shell_quote(const string& s) {
+	string out = "'";
+	for(char c : s) {
+		if(c=='\'') out += "'\\''";
+		else out += c;
+	}
+	return out + "'";
+}
+
+/*
+ * Print the disassembly of every function in namespace bench, with the
+ * instruction addresses stripped.
+ */
+int dump_asm(const string& exe) {
+	const string cmd = "objdump -d -C --no-show-raw-insn " + shell_quote(exe);
+	FILE* pipe = popen(cmd.c_str(),"r");
+	if(!pipe) {
+		cerr << "failed to run: " << cmd << endl;
+		return 1;
+	}
+
+	char line[4096];
+	bool in_kernel = false;
+	while(fgets(line,sizeof(line),pipe)) {
+		const char* name = strchr(line,'<');
+		if(name && strstr(line,">:")) {
+			in_kernel = strncmp(name,"<bench::",8)==0;
+			if(in_kernel)
+				cout << endl << name;
+			continue;
+		}
+
+		if(!in_kernel)
+			continue;
+
+		const char* insn = strchr(line,':');
+		if(!insn)
+			continue;
+
+		// drop the hex address in front of symbolic jump/call targets
+		string text(insn+1+strspn(insn+1," \t"));
+		for(size_t pos=text.find(" <"); pos!=string::npos; pos=text.find(" <",pos+2)) {
+			size_t start = pos;
+			while(start>0 && isxdigit((unsigned char)text[start-1]))
+				--start;
+			if(start<pos && start>0 && text[start-1]==' ') {
+				text.erase(start,pos-start+1);
+				pos = start-1;
+			}
+		}
+		cout << "\t" << text;
+	}
+
+	return pclose(pipe)==0 ? 0 : 1;
+}
+
+int main(int argc, char* argv[])
+{
+	if(argc>1 && string(argv[1])=="--asm")
+		return dump_asm(argc>2 ? string(argv[2]) : self_path(argv[0]));
+
+	const size_t n = argc>1 ? strtoul(argv[1],nullptr,10) : (1<<20);
+	const size_t reps = argc>2 ? strtoul(argv[2],nullptr,10) : 20;
+	if(n==0 || reps==0) {
+		cerr << "usage: " << argv[0] << " [n>0] [reps>0] | --asm [executable]" << endl;
+		return 1;
+	}
+	const size_t np = max<size_t>(2,min<size_t>(n,2048)); // particles for the O(n^2) kernel
+
+	cout << left << setw(12) << "kernel" << right
+		 << setw(14) << "raw ns/el"
+		 << setw(14) << "qty ns/el"
+		 << setw(14) << "unit ns/el"
+		 << setw(12) << "qty/raw"
+		 << setw(12) << "unit/raw" << endl;
+
+	// axpy
+	{
+		vector<double> x(n,1.5), y(n,0.5);
+		vector<velocity_t<>> qx(n,velocity_t<>(1.5));
+		vector<length_t<>> qy(n,length_t<>(0.5));
+		vector<unit<velocity,si_system>> ux(n,unit<velocity,si_system>(1.5));
+		vector<unit<length,si_system>> uy(n,unit<length,si_system>(0.5));
+
+		double raw = time_ns(reps,[&]{ bench::axpy_raw(n,1e-3,x.data(),y.data()); });
+		double qty = time_ns(reps,[&]{ bench::axpy_quantity(n,dims::time_t<>(1e-3),qx.data(),qy.data()); });
+		double unt = time_ns(reps,[&]{ bench::axpy_unit(n,unit<dims::time,si_system>(1e-3),ux.data(),uy.data()); });
+		report("axpy",n,raw,qty,unt);
+	}
+
+	// dot product
+	{
+		vector<double> f(n,2.0), d(n,0.25);
+		vector<force_t<>> qf(n,force_t<>(2.0));
+		vector<length_t<>> qd(n,length_t<>(0.25));
+		vector<unit<force,si_system>> uf(n,unit<force,si_system>(2.0));
+		vector<unit<length,si_system>> ud(n,unit<length,si_system>(0.25));
+
+		double raw = time_ns(reps,[&]{ sink = bench::dot_raw(n,f.data(),d.data()); });
+		double qty = time_ns(reps,[&]{ sink = discard_dims(bench::dot_quantity(n,qf.data(),qd.data())); });
+		double unt = time_ns(reps,[&]{ sink = discard_units(bench::dot_unit(n,uf.data(),ud.data())); });
+		report("dot",n,raw,qty,unt);
+	}
+
+	// n-body forces
+	{
+		vector<double> m(np), x(np), y(np), z(np), fx(np), fy(np), fz(np);
+		for(size_t i=0; i<np; ++i) {
+			m[i] = 1.0 + (i%7);
+			x[i] = double(i%13);
+			y[i] = double(i%17);
+			z[i] = double(i%19);
+		}
+
+		vector<mass_t<>> qm(m.begin(),m.end());
+		vector<length_t<>> qx(x.begin(),x.end()), qy(y.begin(),y.end()), qz(z.begin(),z.end());
+		vector<force_t<>> qfx(np), qfy(np), qfz(np);
+
+		vector<unit<mass,si_system>> um(m.begin(),m.end());
+		vector<unit<length,si_system>> ux(x.begin(),x.end()), uy(y.begin(),y.end()), uz(z.begin(),z.end());
+		vector<unit<force,si_system>> ufx(np), ufy(np), ufz(np);
+
+		const double G = 6.674e-11, eps2 = 1e-2;
+		const size_t nreps = max<size_t>(1,reps/4);
+
+		double raw = time_ns(nreps,[&]{ bench::nbody_raw(np,G,eps2,m.data(),x.data(),y.data(),z.data(),fx.data(),fy.data(),fz.data()); });
+		double qty = time_ns(nreps,[&]{ bench::nbody_quantity(np,quantity<G_dim>(G),area_t<>(eps2),qm.data(),qx.data(),qy.data(),qz.data(),qfx.data(),qfy.data(),qfz.data()); });
+		double unt = time_ns(nreps,[&]{ bench::nbody_unit(np,unit<G_dim,si_system>(G),unit<area,si_system>(eps2),um.data(),ux.data(),uy.data(),uz.data(),ufx.data(),ufy.data(),ufz.data()); });
+		report("nbody",double(np)*np,raw,qty,unt);
+
+		sink = fx[np/2] + discard_dims(qfx[np/2]) + discard_units(ufx[np/2]);
+	}
+
+	// unit conversion chain
+	{
+		const double factor = conversion_factor<area,imperial_system,si_system>()*conversion_factor<area,si_system,cgs_system>();
+
+		vector<double> in(n,3.0), out(n);
+		vector<area_t<>> qin(n,area_t<>(3.0)), qout(n);
+		vector<unit<area,cgs_system>> uin(n,unit<area,cgs_system>(3.0));
+		vector<unit<area,imperial_system>> uout(n);
+
+		double raw = time_ns(reps,[&]{ bench::convert_raw(n,factor,in.data(),out.data()); });
+		double qty = time_ns(reps,[&]{ bench::convert_quantity(n,number_t<>(factor),qin.data(),qout.data()); });
+		double unt = time_ns(reps,[&]{ bench::convert_unit(n,uin.data(),uout.data()); });
+		report("convert",n,raw,qty,unt);
+
+		sink = out[n/2] + discard_dims(qout[n/2]) + discard_units(uout[n/2]);
+	}
+
+	return 0;
+}
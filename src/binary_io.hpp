@@ -0,0 +1,320 @@
+#ifndef BINARY_IO_HPP_
+#define BINARY_IO_HPP_
+
+#include "dims.hpp"
+#include "units.hpp"
+#include "vect.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * A bulk binary format for arrays of quantity<Dim,T> and unit<Dim,System,T>.
+ *
+ * The file is a fixed size header describing the element (dimension
+ * exponents, unit system, scalar type and layout) followed by the raw
+ * elements exactly as they are laid out in memory. Writing is a single pass
+ * over the array and loading memory-maps the file and hands back the data
+ * in place as typed elements, with no copying or per-element parsing. A
+ * load fails (throws std::runtime_error) if the file does not describe the
+ * requested element type, e.g. because the dimensions differ.
+ */
+
+namespace dims {
+
+	namespace binary_io {
+
+		constexpr size_t max_base_dims = 16;
+		constexpr uint32_t version = 1;
+		constexpr uint32_t byte_order = 0x01020304;
+		constexpr uint32_t data_offset = 256; // keeps the elements 64-byte aligned in the mapping
+
+		struct header {
+			char magic[8];
+			uint32_t version;
+			uint32_t byte_order;
+			uint32_t data_offset;
+			uint32_t element_size;      // sizeof one element, including any padding
+			uint64_t count;             // number of elements
+			uint32_t components;        // scalars per element, e.g. N for nvect<N,T>
+			uint32_t scalar_size;
+			char scalar_kind;           // 'f' floating point, 'i' signed or 'u' unsigned integer
+			uint8_t base_dims;          // number of base dimensions stored in exponents
+			uint8_t reserved[6];
+			int32_t exponents[2*max_base_dims]; // numerator/denominator pairs
+			char system[32];            // unit system name, empty for dimension-only quantities
+		};
+
+		static_assert(sizeof(header)<=data_offset,"binary_io header does not fit before the data");
+
+		constexpr char magic[8] = {'Q','T','Y','A','R','R','\0','\0'};
+
+		/*
+		 * Description of the value types which can be stored.
+		 */
+		template<class T, class Enable=void>
+		struct value_traits;
+
+		template<class T>
+		struct value_traits<T,typename std::enable_if<std::is_arithmetic<T>::value>::type> {
+			using scalar_type = T;
+			static constexpr size_t components = 1;
+			static constexpr char kind = std::is_floating_point<T>::value ? 'f' : (std::is_signed<T>::value ? 'i' : 'u');
+		};
+
+		template<size_t N, class T>
+		struct value_traits<nvect<N,T>> {
+			using scalar_type = typename value_traits<T>::scalar_type;
+			static constexpr size_t components = N*value_traits<T>::components;
+			static constexpr char kind = value_traits<T>::kind;
+		};
+
+		/*
+		 * Description of the element types which can be stored.
+		 */
+		template<class Q>
+		struct element_traits;
+
+		template<class Dim, class T>
+		struct element_traits<quantity<Dim,T>> {
+			using dimension = Dim;
+			using value_type = T;
+			static const char* system() { return ""; }
+		};
+
+		template<class Dim, class System, class T>
+		struct element_traits<units::unit<Dim,System,T>> {
+			using dimension = Dim;
+			using value_type = T;
+			static const char* system() { return units::system_name<System>::value; }
+		};
+
+		// write the exponents of a dimension as numerator/denominator pairs
+		template<class Dim>
+		struct exponents_impl {
+			static void fill(int32_t* out) {
+				out[0] = (int32_t)Dim::value::num;
+				out[1] = (int32_t)Dim::value::den;
+				exponents_impl<typename Dim::tail>::fill(out+2);
+			}
+		};
+
+		template<>
+		struct exponents_impl<lists::end_element> {
+			static void fill(int32_t*) {}
+		};
+
+		template<class Q>
+		header make_header(uint64_t count) {
+			using traits = element_traits<Q>;
+			using vtraits = value_traits<typename traits::value_type>;
+			using Dim = typename traits::dimension;
+
+			static_assert(std::is_trivially_copyable<Q>::value,"binary_io requires trivially copyable elements");
+			static_assert(lists::list_length<Dim>::value<=(int)max_base_dims,"Too many base dimensions for binary_io");
+
+			header h;
+			std::memset(&h,0,sizeof(h));
+			std::memcpy(h.magic,magic,sizeof(magic));
+			h.version = version;
+			h.byte_order = byte_order;
+			h.data_offset = data_offset;
+			h.element_size = sizeof(Q);
+			h.count = count;
+			h.components = vtraits::components;
+			h.scalar_size = sizeof(typename vtraits::scalar_type);
+			h.scalar_kind = vtraits::kind;
+			h.base_dims = lists::list_length<Dim>::value;
+			exponents_impl<Dim>::fill(h.exponents);
+			std::strncpy(h.system,traits::system(),sizeof(h.system)-1);
+			return h;
+		}
+
+		inline std::string describe_dims(const header& h) {
+			std::string out = "<";
+			for(size_t i=0; i<h.base_dims && i<max_base_dims; ++i) {
+				if(i>0)
+					out += ",";
+				out += std::to_string(h.exponents[2*i]);
+				if(h.exponents[2*i+1]!=1)
+					out += "/" + std::to_string(h.exponents[2*i+1]);
+			}
+			return out + ">";
+		}
+
+		// check a header read from file against the one expected for Q
+		template<class Q>
+		void check_header(const header& h, uint64_t file_size, const std::string& path) {
+			const header expected = make_header<Q>(h.count);
+			const std::string where = "binary_io: '" + path + "': ";
+
+			if(file_size<sizeof(header) || std::memcmp(h.magic,magic,sizeof(magic))!=0)
+				throw std::runtime_error(where + "not a quantity array file");
+			if(h.version!=version)
+				throw std::runtime_error(where + "unsupported version " + std::to_string(h.version));
+			if(h.byte_order!=byte_order)
+				throw std::runtime_error(where + "written with a different byte order");
+			// validate the untrusted dimension fields before formatting them
+			bool dims_valid = h.base_dims<=max_base_dims;
+			for(size_t i=0; dims_valid && i<h.base_dims; ++i)
+				dims_valid = h.exponents[2*i+1]!=0;
+			if(!dims_valid)
+				throw std::runtime_error(where + "corrupt dimension header");
+			if(h.base_dims!=expected.base_dims || std::memcmp(h.exponents,expected.exponents,sizeof(h.exponents))!=0)
+				throw std::runtime_error(where + "dimension mismatch, file has " + describe_dims(h) + " but " + describe_dims(expected) + " was requested");
+			if(std::strncmp(h.system,expected.system,sizeof(h.system))!=0)
+				throw std::runtime_error(where + "unit system mismatch, file has '" + std::string(h.system,strnlen(h.system,sizeof(h.system)))
+											+ "' but '" + expected.system + "' was requested");
+			if(h.scalar_kind!=expected.scalar_kind || h.scalar_size!=expected.scalar_size
+				|| h.components!=expected.components || h.element_size!=expected.element_size)
+				throw std::runtime_error(where + "element type mismatch");
+			if(h.element_size==0)
+				throw std::runtime_error(where + "element type mismatch");
+			// the header fields are untrusted, so compare without overflowing
+			if(h.data_offset<sizeof(header) || h.data_offset>file_size
+				|| h.count > (file_size - h.data_offset)/h.element_size)
+				throw std::runtime_error(where + "file is truncated");
+			// the mapping is page aligned, so aligned offsets give aligned elements
+			if(h.data_offset % alignof(Q)!=0)
+				throw std::runtime_error(where + "misaligned data offset " + std::to_string(h.data_offset));
+		}
+
+		inline void write_all(int fd, const void* data, size_t bytes, const std::string& path) {
+			const char* p = static_cast<const char*>(data);
+			while(bytes>0) {
+				ssize_t n = ::write(fd,p,bytes);
+				if(n<0) {
+					::close(fd);
+					throw std::runtime_error("binary_io: write to '" + path + "' failed");
+				}
+				p += n;
+				bytes -= n;
+			}
+		}
+
+		/*
+		 * Write n elements to a file. The header and the elements each go out
+		 * in a single write.
+		 */
+		template<class Q>
+		void write(const std::string& path, const Q* data, size_t n) {
+			char block[data_offset] = {};
+			const header h = make_header<Q>(n);
+			std::memcpy(block,&h,sizeof(h));
+
+			int fd = ::open(path.c_str(),O_WRONLY|O_CREAT|O_TRUNC,0644);
+			if(fd<0)
+				throw std::runtime_error("binary_io: cannot open '" + path + "' for writing");
+
+			write_all(fd,block,sizeof(block),path);
+			write_all(fd,data,n*sizeof(Q),path);
+
+			if(::close(fd)!=0)
+				throw std::runtime_error("binary_io: closing '" + path + "' failed");
+		}
+
+		template<class Q>
+		void write(const std::string& path, const std::vector<Q>& data) {
+			write(path,data.data(),data.size());
+		}
+
+		/*
+		 * A read-only, memory-mapped array of elements. The elements are used in
+		 * place from the mapping, which is released when this is destroyed.
+		 */
+		template<class Q>
+		class mapped_array {
+		public:
+			using value_type = Q;
+			using const_iterator = const Q*;
+
+			mapped_array() :base(nullptr), bytes(0), first(nullptr), n(0) {}
+
+			mapped_array(mapped_array&& rhs) noexcept
+			:base(rhs.base), bytes(rhs.bytes), first(rhs.first), n(rhs.n) {
+				rhs.base = nullptr;
+				rhs.bytes = rhs.n = 0;
+				rhs.first = nullptr;
+			}
+
+			mapped_array& operator=(mapped_array&& rhs) noexcept {
+				std::swap(base,rhs.base);
+				std::swap(bytes,rhs.bytes);
+				std::swap(first,rhs.first);
+				std::swap(n,rhs.n);
+				return *this;
+			}
+
+			mapped_array(const mapped_array&) = delete;
+			mapped_array& operator=(const mapped_array&) = delete;
+
+			~mapped_array() {
+				if(base)
+					::munmap(base,bytes);
+			}
+
+			size_t size() const { return n; }
+			bool empty() const { return n==0; }
+			const Q* data() const { return first; }
+			const Q& operator[](size_t i) const { return first[i]; }
+			const_iterator begin() const { return first; }
+			const_iterator end() const { return first+n; }
+
+			template<class Q2>
+			friend mapped_array<Q2> load(const std::string& path);
+
+		private:
+			void* base;
+			size_t bytes;
+			const Q* first;
+			size_t n;
+		};
+
+		/*
+		 * Memory-map a file written by write(). Throws if the file does not hold
+		 * elements of type Q.
+		 */
+		template<class Q>
+		mapped_array<Q> load(const std::string& path) {
+			int fd = ::open(path.c_str(),O_RDONLY);
+			if(fd<0)
+				throw std::runtime_error("binary_io: cannot open '" + path + "' for reading");
+
+			struct stat st;
+			if(::fstat(fd,&st)!=0 || (size_t)st.st_size<sizeof(header)) {
+				::close(fd);
+				throw std::runtime_error("binary_io: '" + path + "': not a quantity array file");
+			}
+
+			void* base = ::mmap(nullptr,st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+			::close(fd);
+			if(base==MAP_FAILED)
+				throw std::runtime_error("binary_io: cannot map '" + path + "'");
+
+			mapped_array<Q> out;
+			out.base = base;
+			out.bytes = st.st_size;
+
+			header h;
+			std::memcpy(&h,base,sizeof(h));
+			check_header<Q>(h,st.st_size,path); // out unmaps on failure
+
+			out.first = reinterpret_cast<const Q*>(static_cast<const char*>(base)+h.data_offset);
+			out.n = h.count;
+			return out;
+		}
+
+	}; // namespace binary_io
+
+}; // namespace dims
+
+#endif /* BINARY_IO_HPP_ */
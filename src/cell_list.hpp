@@ -0,0 +1,385 @@
+#ifndef CELL_LIST_HPP_
+#define CELL_LIST_HPP_
+
+#include "dims.hpp"
+#include "parallel.hpp"
+#include "vect.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+/*
+ * Linked-cell (uniform grid) neighbour search for sets of positions.
+ *
+ * The bounding box of the positions is cut into cells at least as wide as
+ * the cutoff, so neighbours within the cutoff are in the same or an adjacent
+ * cell and finding all pairs costs O(N) instead of O(N^2):
+ *
+ *     cell_list<3> cells(quantity<length>(2.5));
+ *     cells.build(x);                                  // any indexable range of positions
+ *     cells.for_each_pair([&](uint32_t i, uint32_t j, const quantity<position,nvect<3>>& dr) {
+ *         ... // |dr| < cutoff, dr = x[i]-x[j], each pair once
+ *     });
+ *
+ * The particles are binned with a counting sort into contiguous arrays
+ * (cell start offsets, particle indices and a copy of the positions in cell
+ * order). update() reuses the grid and the arrays and only re-sorts when a
+ * particle has changed cell. There are no periodic boundaries.
+ */
+
+namespace dims {
+
+	template<size_t N, class T=double>
+	class cell_list {
+
+	public:
+		using index_type = uint32_t;
+		using position_type = quantity<position,nvect<N,T>>;
+
+		explicit cell_list(const quantity<length,T>& cutoff, unsigned threads=1)
+		:cutoff(discard_dims(cutoff)), threads(threads), ncells_total(0) {
+			if(!(this->cutoff>T(0)))
+				throw std::invalid_argument("cell_list: the cutoff must be positive");
+		}
+
+		size_t size() const { return cell_of.size(); }
+		size_t cells() const { return ncells_total; }
+		const std::array<size_t,N>& grid() const { return ncells; }
+		quantity<length,T> cutoff_length() const { return quantity<length,T>(cutoff); }
+
+		/*
+		 * Bins the positions from scratch. Positions is anything with size()
+		 * and operator[] giving something convertible to position_type, e.g. a
+		 * std::vector of quantities or a quantity_span.
+		 */
+		template<class Positions>
+		void build(const Positions& x) {
+			load(x);
+			make_grid();
+			bin();
+		}
+
+		/*
+		 * Rebins after the positions have moved. The grid is kept while every
+		 * position is still inside it, and the sort is skipped if no particle
+		 * changed cell. Returns true if the particles were re-sorted.
+		 */
+		template<class Positions>
+		bool update(const Positions& x) {
+			if(x.size()!=size() || ncells_total==0) {
+				build(x);
+				return true;
+			}
+			load(x);
+			if(!inside_grid()) {
+				make_grid();
+				bin();
+				return true;
+			}
+
+			std::atomic<bool> moved(false);
+			parallel_chunks([&](size_t lo, size_t hi) {
+				bool m = false;
+				for(size_t i=lo; i<hi; ++i) {
+					const index_type c = cell_id(raw[i]);
+					m |= c!=cell_of[i];
+					cell_of[i] = c;
+				}
+				if(m)
+					moved = true;
+			});
+
+			if(moved) {
+				sort();
+				return true;
+			}
+			gather();
+			return false;
+		}
+
+		/*
+		 * Particle indices of cell c, in the contiguous sorted order.
+		 */
+		const index_type* cell_begin(size_t c) const { return order.data()+cell_start[c]; }
+		const index_type* cell_end(size_t c) const { return order.data()+cell_start[c+1]; }
+
+		/*
+		 * Calls f(i,j,x[i]-x[j]) once for every pair closer than the cutoff. The
+		 * half shell of neighbouring cells is visited so there are no
+		 * duplicates. Serial, so f may update both particles.
+		 */
+		template<class F>
+		void for_each_pair(F&& f) const {
+			const T rc2 = cutoff*cutoff;
+			std::array<ptrdiff_t,N> cell;
+			for(size_t c=0; c<ncells_total; ++c) {
+				unflatten(c,cell);
+				const index_type b = cell_start[c], e = cell_start[c+1];
+				// pairs within the cell
+				for(index_type a=b; a<e; ++a)
+					for(index_type a2=a+1; a2<e; ++a2)
+						visit(a,a2,rc2,f);
+				// pairs with the forward half of the neighbouring cells
+				for(const auto& off : half_shell) {
+					const ptrdiff_t c2 = neighbour_cell(cell,off);
+					if(c2<0)
+						continue;
+					for(index_type a=b; a<e; ++a)
+						for(index_type a2=cell_start[c2]; a2<cell_start[c2+1]; ++a2)
+							visit(a,a2,rc2,f);
+				}
+			}
+		}
+
+		/*
+		 * Calls f(i,j,x[i]-x[j]) for every particle i and each neighbour j closer
+		 * than the cutoff, so every pair is seen twice. Particles are shared
+		 * between the threads, so f may only update particle i.
+		 */
+		template<class F>
+		void for_each_neighbour(F&& f) const {
+			const T rc2 = cutoff*cutoff;
+			parallel_for(ncells_total,threads,[&](size_t c) {
+				std::array<ptrdiff_t,N> cell;
+				unflatten(c,cell);
+				for(index_type a=cell_start[c]; a<cell_start[c+1]; ++a) {
+					for(const auto& off : full_shell) {
+						const ptrdiff_t c2 = neighbour_cell(cell,off);
+						if(c2<0)
+							continue;
+						for(index_type a2=cell_start[c2]; a2<cell_start[c2+1]; ++a2)
+							if(a2!=a)
+								visit(a,a2,rc2,f);
+					}
+				}
+			});
+		}
+
+		// all pairs closer than the cutoff, each once with i<j
+		std::vector<std::pair<index_type,index_type>> pairs() const {
+			std::vector<std::pair<index_type,index_type>> out;
+			for_each_pair([&](index_type i, index_type j, const position_type&) {
+				out.emplace_back(std::min(i,j),std::max(i,j));
+			});
+			return out;
+		}
+
+	private:
+		template<class Positions>
+		void load(const Positions& x) {
+			if(x.size()>size_t(std::numeric_limits<index_type>::max()))
+				throw std::length_error("cell_list: too many positions for 32 bit indices");
+			raw.resize(x.size());
+			parallel_chunks([&](size_t lo, size_t hi) {
+				for(size_t i=lo; i<hi; ++i) {
+					const position_type p = x[i]; // also converts quantity_ref proxies
+					raw[i] = discard_dims(p);
+				}
+			});
+		}
+
+		// the bounding box and the number of cells along each direction
+		void make_grid() {
+			const size_t n = raw.size();
+			for(size_t d=0; d<N; ++d) {
+				lo[d] = n ? raw[0][d] : T(0);
+				hi[d] = lo[d];
+			}
+			for(size_t i=1; i<n; ++i)
+				for(size_t d=0; d<N; ++d) {
+					lo[d] = std::min(lo[d],raw[i][d]);
+					hi[d] = std::max(hi[d],raw[i][d]);
+				}
+
+			// cells at least as wide as the cutoff, but not many more than particles
+			// (and few enough for cell indices to fit index_type)
+			const size_t max_cells = std::min<size_t>(8*n+8,std::numeric_limits<index_type>::max());
+			T width = cutoff;
+			for(;;) {
+				size_t total = 1;
+				bool fits = true;
+				for(size_t d=0; d<N && fits; ++d) {
+					// clamp in floating point so the conversion cannot overflow
+					const T q = std::floor((hi[d]-lo[d])/width);
+					ncells[d] = q>=T(max_cells) ? max_cells : q>=T(1) ? (size_t)q : 1;
+					fits = ncells[d]<=max_cells/total;
+					total *= fits ? ncells[d] : 1;
+				}
+				if(fits)
+					break;
+				width *= 2;
+			}
+
+			ncells_total = 1;
+			for(size_t d=0; d<N; ++d) {
+				inv_width[d] = T(ncells[d])/std::max(hi[d]-lo[d],std::numeric_limits<T>::min());
+				ncells_total *= ncells[d];
+			}
+			make_shells();
+		}
+
+		bool inside_grid() const {
+			bool inside = true;
+			for(size_t i=0; i<raw.size() && inside; ++i)
+				for(size_t d=0; d<N; ++d)
+					inside &= raw[i][d]>=lo[d] && raw[i][d]<=hi[d];
+			return inside;
+		}
+
+		index_type cell_id(const nvect<N,T>& x) const {
+			size_t c = 0;
+			for(size_t d=0; d<N; ++d) {
+				const size_t k = std::min<size_t>(ncells[d]-1,(size_t)((x[d]-lo[d])*inv_width[d]));
+				c = c*ncells[d] + k;
+			}
+			return index_type(c);
+		}
+
+		void unflatten(size_t c, std::array<ptrdiff_t,N>& cell) const {
+			for(size_t d=N; d-->0;) {
+				cell[d] = ptrdiff_t(c % ncells[d]);
+				c /= ncells[d];
+			}
+		}
+
+		// flat index of cell+off, or -1 outside the grid
+		ptrdiff_t neighbour_cell(const std::array<ptrdiff_t,N>& cell, const std::array<ptrdiff_t,N>& off) const {
+			ptrdiff_t c = 0;
+			for(size_t d=0; d<N; ++d) {
+				const ptrdiff_t k = cell[d]+off[d];
+				if(k<0 || k>=ptrdiff_t(ncells[d]))
+					return -1;
+				c = c*ptrdiff_t(ncells[d]) + k;
+			}
+			return c;
+		}
+
+		// the 3^N neighbouring cell offsets, and the half after (0,...,0)
+		void make_shells() {
+			full_shell.clear();
+			half_shell.clear();
+			std::array<ptrdiff_t,N> off;
+			size_t count = 1;
+			for(size_t d=0; d<N; ++d)
+				count *= 3;
+			for(size_t k=0; k<count; ++k) {
+				size_t r = k;
+				for(size_t d=N; d-->0;) {
+					off[d] = ptrdiff_t(r%3)-1;
+					r /= 3;
+				}
+				// only neighbours that exist along each direction
+				bool needed = true;
+				for(size_t d=0; d<N; ++d)
+					needed &= off[d]==0 || ncells[d]>1;
+				if(!needed)
+					continue;
+				full_shell.push_back(off);
+				if(k>count/2)
+					half_shell.push_back(off);
+			}
+		}
+
+		void bin() {
+			cell_of.resize(raw.size());
+			parallel_chunks([&](size_t lo, size_t hi) {
+				for(size_t i=lo; i<hi; ++i)
+					cell_of[i] = cell_id(raw[i]);
+			});
+			sort();
+		}
+
+		/*
+		 * Parallel counting sort by cell. Each thread counts its chunk, the
+		 * counts are scanned in (cell,thread) order and each thread scatters its
+		 * chunk, which keeps the particles of a cell in index order.
+		 */
+		void sort() {
+			const size_t n = raw.size();
+			const unsigned t = chunk_count();
+			counts.assign(size_t(t)*ncells_total,0);
+			parallel_run(t,[&](unsigned tid, unsigned nt) {
+				index_type* cnt = counts.data()+size_t(tid)*ncells_total;
+				for(size_t i=n*tid/nt; i<n*(tid+1)/nt; ++i)
+					++cnt[cell_of[i]];
+			});
+
+			cell_start.resize(ncells_total+1);
+			index_type sum = 0;
+			for(size_t c=0; c<ncells_total; ++c) {
+				cell_start[c] = sum;
+				for(unsigned tid=0; tid<t; ++tid) {
+					index_type& cnt = counts[size_t(tid)*ncells_total+c];
+					const index_type k = cnt;
+					cnt = sum;
+					sum += k;
+				}
+			}
+			cell_start[ncells_total] = sum;
+
+			order.resize(n);
+			parallel_run(t,[&](unsigned tid, unsigned nt) {
+				index_type* next = counts.data()+size_t(tid)*ncells_total;
+				for(size_t i=n*tid/nt; i<n*(tid+1)/nt; ++i)
+					order[next[cell_of[i]]++] = index_type(i);
+			});
+			gather();
+		}
+
+		// copy the positions into cell order
+		void gather() {
+			sorted.resize(order.size());
+			parallel_chunks([&](size_t lo, size_t hi) {
+				for(size_t a=lo; a<hi; ++a)
+					sorted[a] = raw[order[a]];
+			});
+		}
+
+		template<class F>
+		void visit(index_type a, index_type a2, T rc2, F& f) const {
+			const nvect<N,T> dr = sorted[a]-sorted[a2];
+			if(dr.dot(dr) < rc2)
+				f(order[a],order[a2],position_type(dr));
+		}
+
+		unsigned chunk_count() const {
+			const unsigned t = threads ? threads : default_threads();
+			return (unsigned)std::max<size_t>(1,std::min<size_t>(t,raw.size()/4096));
+		}
+
+		// f(lo,hi) over [0,size) in one contiguous chunk per thread
+		template<class F>
+		void parallel_chunks(F f) const {
+			const size_t n = raw.size();
+			parallel_run(chunk_count(),[&](unsigned tid, unsigned nt) {
+				f(n*tid/nt,n*(tid+1)/nt);
+			});
+		}
+
+		T cutoff;
+		unsigned threads;
+
+		std::array<T,N> lo, hi, inv_width;
+		std::array<size_t,N> ncells;
+		size_t ncells_total;
+		std::vector<std::array<ptrdiff_t,N>> full_shell, half_shell;
+
+		std::vector<nvect<N,T>> raw;        // positions by particle index
+		std::vector<index_type> cell_of;    // cell of each particle
+		std::vector<index_type> counts;     // per thread histograms, then scatter offsets
+		std::vector<index_type> cell_start; // first sorted slot of each cell, plus the total
+		std::vector<index_type> order;      // particle indices sorted by cell
+		std::vector<nvect<N,T>> sorted;     // positions in sorted order
+	};
+
+}; // namespace dims
+
+#endif /* CELL_LIST_HPP_ */
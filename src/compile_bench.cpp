@@ -0,0 +1,62 @@
+/*
+ * Compile time benchmark for the dimension machinery.
+ *
+ * Builds a chain of COMPILE_BENCH_DEPTH quantity operations (multiply,
+ * divide, sqrt) where every step has a distinct dimension made of
+ * COMPILE_BENCH_BASES base dimensions, so each step instantiates fresh
+ * mult/inv/pow_Dimension lists. compile_bench.sh compiles this for a range
+ * of base counts and checks build time and object size against a budget.
+ */
+
+#include <cstdio>
+#include <utility>
+
+#include "dims.hpp"
+
+#ifndef COMPILE_BENCH_BASES
+#define COMPILE_BENCH_BASES 7
+#endif
+
+#ifndef COMPILE_BENCH_DEPTH
+#define COMPILE_BENCH_DEPTH 64
+#endif
+
+using namespace dims;
+
+// the K-th test dimension, exponents in [-2,2] varying with K and the base
+template<int K, class Seq>
+struct bench_dim;
+
+template<int K, size_t... Is>
+struct bench_dim<K,std::index_sequence<Is...>> {
+	using type = Dimension<std::ratio<(int)((K+3*Is)%5)-2>...>;
+};
+
+template<int K>
+using bench_dim_t = typename bench_dim<K,std::make_index_sequence<COMPILE_BENCH_BASES>>::type;
+
+template<int K>
+struct chain {
+	template<class Dim>
+	static double run(quantity<Dim> q, const double* in) {
+		const quantity<bench_dim_t<K>> a(in[K%4]);
+		auto b = (q*a)/sqrt(a*a);       // same dimensions as q, three new lists on the way
+		auto c = b*quantity<bench_dim_t<K+1>>(in[(K+1)%4]);
+		return chain<K+1>::run(c,in);
+	}
+};
+
+template<>
+struct chain<COMPILE_BENCH_DEPTH> {
+	template<class Dim>
+	static double run(quantity<Dim> q, const double*) {
+		return discard_dims(q);
+	}
+};
+
+int main(int argc, char**) {
+	const double in[4] = {1.0+argc, 2.0, 0.5, 1.5};
+	const quantity<bench_dim_t<0>> q(in[0]);
+	std::printf("%g\n",chain<0>::run(q,in));
+	return 0;
+}
@@ -0,0 +1,43 @@
+#!/bin/sh
+#
+# Compiles compile_bench.cpp for 3..MAX_BASES base dimensions and reports the
+# compile time and object size of each translation unit. Exits non-zero if
+# any build is over budget.
+#
+#   ./compile_bench.sh [max_seconds] [max_object_kb]
+#
+# CXX, CXXFLAGS, DEPTH and MAX_BASES can be set in the environment.
+
+set -e
+
+CXX=${CXX:-g++}
+CXXFLAGS=${CXXFLAGS:--std=c++17 -O2}
+DEPTH=${DEPTH:-64}
+MAX_BASES=${MAX_BASES:-16}
+BUDGET_S=${1:-${BUDGET_S:-10}}
+BUDGET_KB=${2:-${BUDGET_KB:-64}}
+
+DIR=$(cd "$(dirname "$0")" && pwd)
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+status=0
+printf "%6s %10s %10s\n" bases seconds object_kb
+n=3
+while [ $n -le $MAX_BASES ]; do
+	obj="$TMP/bench_$n.o"
+	start=$(date +%s.%N)
+	$CXX $CXXFLAGS -I"$DIR" -DCOMPILE_BENCH_BASES=$n -DCOMPILE_BENCH_DEPTH=$DEPTH \
+		-c "$DIR/compile_bench.cpp" -o "$obj"
+	end=$(date +%s.%N)
+	secs=$(awk "BEGIN{print $end - $start}")
+	kb=$(( ($(wc -c < "$obj") + 1023) / 1024 ))
+	flag=""
+	if awk "BEGIN{exit !($secs > $BUDGET_S)}" || [ $kb -gt $BUDGET_KB ]; then
+		flag="  over budget (${BUDGET_S}s, ${BUDGET_KB}kB)"
+		status=1
+	fi
+	printf "%6d %10.2f %10d%s\n" $n $secs $kb "$flag"
+	n=$((n+1))
+done
+exit $status
@@ -0,0 +1,79 @@
+#ifndef CONSTANTS_HPP_
+#define CONSTANTS_HPP_
+
+#include "dims.hpp"
+#include "units.hpp"
+
+/*
+ * Physical constants (CODATA 2018).
+ *
+ * dims::constants holds them as quantities with SI values, next to
+ * dims::pi etc. units::codata holds the same constants as units in any
+ * system, converted at compile time:
+ *
+ *     constexpr auto g = units::codata::g_n<units::imperial_system>; // ft/s^2
+ *     constexpr auto E = dims::constants::m_e*dims::constants::c*dims::constants::c;
+ */
+
+namespace dims {
+
+	typedef IntDim<-1,3,-2>	gravitational_constant;
+	typedef IntDim<1,2,-1>	action;
+	typedef IntDim<0,0,0,0,-1>	per_amount;
+	typedef IntDim<1,2,-2,-1,-1>	molar_entropy;
+
+	namespace constants {
+
+		constexpr quantity<gravitational_constant> G(6.67430e-11); // Newtonian constant of gravitation
+		constexpr quantity<velocity> c(299792458.0);                // speed of light in vacuum (exact)
+		constexpr quantity<action> h(6.62607015e-34);              // Planck constant (exact)
+		constexpr quantity<action> hbar = h/(quantity<number>(2.0)*pi); // reduced Planck constant
+		constexpr quantity<mass> m_e(9.1093837015e-31);            // electron mass
+		constexpr quantity<mass> m_p(1.67262192369e-27);           // proton mass
+		constexpr quantity<mass> m_n(1.67492749804e-27);           // neutron mass
+		constexpr quantity<mass> u(1.66053906660e-27);             // atomic mass constant
+		constexpr quantity<acceleration> g_n(9.80665);             // standard acceleration of gravity (exact)
+		constexpr quantity<pressure> atm(101325.0);                // standard atmosphere (exact)
+		constexpr quantity<entropy> k_B(1.380649e-23);             // Boltzmann constant (exact)
+		constexpr quantity<per_amount> N_A(6.02214076e23);         // Avogadro constant (exact)
+		constexpr quantity<molar_entropy> R = k_B*N_A;             // molar gas constant
+		constexpr quantity<charge> e(1.602176634e-19);             // elementary charge (exact)
+
+	}; // namespace constants
+
+}; // namespace dims
+
+namespace units
+{
+
+	// the unit in System equal to the SI quantity q
+	template<class System, class Dim, class T>
+	constexpr unit<Dim,System,T> in_system(const dims::quantity<Dim,T>& q) {
+		return unit<Dim,System,T>(unit<Dim,si_system,T>(discard_dims(q)));
+	}
+
+	namespace codata
+	{
+
+		template<class System = si_system> inline constexpr auto G    = in_system<System>(dims::constants::G);
+		template<class System = si_system> inline constexpr auto c    = in_system<System>(dims::constants::c);
+		template<class System = si_system> inline constexpr auto h    = in_system<System>(dims::constants::h);
+		template<class System = si_system> inline constexpr auto hbar = in_system<System>(dims::constants::hbar);
+		template<class System = si_system> inline constexpr auto m_e  = in_system<System>(dims::constants::m_e);
+		template<class System = si_system> inline constexpr auto m_p  = in_system<System>(dims::constants::m_p);
+		template<class System = si_system> inline constexpr auto m_n  = in_system<System>(dims::constants::m_n);
+		template<class System = si_system> inline constexpr auto u    = in_system<System>(dims::constants::u);
+		template<class System = si_system> inline constexpr auto g_n  = in_system<System>(dims::constants::g_n);
+		template<class System = si_system> inline constexpr auto atm  = in_system<System>(dims::constants::atm);
+		template<class System = si_system> inline constexpr auto k_B  = in_system<System>(dims::constants::k_B);
+		template<class System = si_system> inline constexpr auto N_A  = in_system<System>(dims::constants::N_A);
+		template<class System = si_system> inline constexpr auto R    = in_system<System>(dims::constants::R);
+		template<class System = si_system> inline constexpr auto e    = in_system<System>(dims::constants::e);
+
+		static_assert(discard_units(c<cgs_system>)==29979245800.0,"c in cm/s should be exact");
+
+	} // namespace codata
+
+} // namespace units
+
+#endif /* CONSTANTS_HPP_ */
@@ -3,9 +3,13 @@
 
 #include "lists.hpp"
 #include <cmath>
+#include <cstdint>
+#include <limits>
 #include <ratio>
 #include <type_traits>
 
+#include "instrument.hpp" // DIMS_CONSTANT_EVALUATED and the optional DIMS_INSTRUMENT hooks
+
 namespace dims {
 
 	using namespace lists;
@@ -48,6 +52,105 @@ namespace dims {
 	template< class Dim >
 	using sqrt_Dimension = pow_Dimension<Dim,std::ratio<1,2>>;
 
+	/*
+	 * Maths usable in constant expressions. At compile time these use the
+	 * loops below, at runtime they call the <cmath> functions as before. Without
+	 * compiler support for DIMS_CONSTANT_EVALUATED they are runtime only.
+	 */
+
+	// x^n for integer n by repeated squaring
+	constexpr long double ipow(long double x, intmax_t n) {
+		if(n<0)
+			return 1.0L/ipow(x,-n);
+		long double out = 1.0L;
+		while(n>0) {
+			if(n&1)
+				out *= x;
+			x *= x;
+			n >>= 1;
+		}
+		return out;
+	}
+
+	// the positive n-th root of x>0 by Newton's method
+	constexpr long double iroot(long double x, intmax_t n) {
+		if(n==1 || x==1.0L)
+			return x;
+		long double y = x>1.0L ? x : 1.0L;
+		for(int i=0; i<1000; ++i) {
+			const long double next = ((n-1)*y + x/ipow(y,n-1))/n;
+			if(next>=y) // the iteration decreases monotonically to the root from above
+				break;
+			y = next;
+		}
+		return y;
+	}
+
+	template<class T>
+	constexpr T constexpr_sqrt(T x) {
+		if constexpr(std::is_floating_point<T>::value) {
+			if(DIMS_CONSTANT_EVALUATED()) {
+				if(x<0 || x!=x)
+					return std::numeric_limits<T>::quiet_NaN();
+				return (x==0 || x==std::numeric_limits<T>::infinity()) ? x : (T)iroot(x,2);
+			}
+		}
+		using std::sqrt;
+		return sqrt(x);
+	}
+
+	// x^(num/den)
+	template<class T>
+	constexpr T constexpr_pow(T x, intmax_t num, intmax_t den) {
+		if constexpr(std::is_floating_point<T>::value) {
+			if(DIMS_CONSTANT_EVALUATED()) {
+				if(den==1)
+					return (T)ipow(x,num);
+				if(x<0 || x!=x)
+					return std::numeric_limits<T>::quiet_NaN();
+				if(x==0)
+					return num>0 ? T(0) : std::numeric_limits<T>::infinity();
+				return (T)iroot(ipow(x,num),den);
+			}
+		}
+		using std::pow;
+		return pow(x,(double)num/(double)den);
+	}
+
+	template<class T>
+	constexpr T constexpr_floor(T x) {
+		if constexpr(std::is_floating_point<T>::value) {
+			if(DIMS_CONSTANT_EVALUATED()) {
+				if(x!=x || x>=T(1ll<<62) || x<=-T(1ll<<62))
+					return x; // nan, inf or already integral
+				const T t = (T)(long long)x;
+				return t>x ? t-1 : t;
+			}
+		}
+		using std::floor;
+		return floor(x);
+	}
+
+	template<class T>
+	constexpr T constexpr_ceil(T x) {
+		if constexpr(std::is_floating_point<T>::value) {
+			if(DIMS_CONSTANT_EVALUATED())
+				return -constexpr_floor(-x);
+		}
+		using std::ceil;
+		return ceil(x);
+	}
+
+	// lazily evaluated quantity arithmetic (see quantity_expr.hpp)
+	template<class Dim, class E>
+	struct quantity_expr;
+
+	namespace expr {
+		// the length of a vector value type, 0 for other types
+		template<class V>
+		struct vect_size;
+	};
+
 	/*
 	 * A wrapper for data which includes information about dimensions.
 	 * With compiler optimisations this has no overhead (tested with g++ 4.7 with -O3).
@@ -63,7 +166,7 @@ namespace dims {
 
 		// basic constructors
 		constexpr quantity():val(){}
-		explicit quantity(T val):val(val){}
+		constexpr explicit quantity(T val):val(val){}
 
 		// forward constructor (allows one to use constructor arguments of underlying value type)
 		template<typename... Ts>
@@ -78,9 +181,45 @@ namespace dims {
 
 		// assignment
 		template<class Dim2>
-		quantity<Dim,T>& operator=(const quantity<Dim2,T>& rhs){
+		constexpr quantity<Dim,T>& operator=(const quantity<Dim2,T>& rhs){
+			static_assert(std::is_same<Dim,Dim2>::value,"Cannot assign quantities with different dimensions.");
+			val = rhs.val;
+			return *this;
+		}
+
+		/*
+		 * Evaluate a lazy expression directly into val in a single pass with no
+		 * temporaries (see quantity_expr.hpp).
+		 */
+		template<class Dim2, class E>
+		quantity(const quantity_expr<Dim2,E>& e) {
+			static_assert(std::is_same<Dim,Dim2>::value,"Cannot copy quantity with different dimensions.");
+			static_assert(E::size==expr::vect_size<T>::value,"Cannot evaluate a vector expression into a vector of a different length.");
+			e.eval_to(val);
+		}
+
+		template<class Dim2, class E>
+		quantity<Dim,T>& operator=(const quantity_expr<Dim2,E>& e) {
 			static_assert(std::is_same<Dim,Dim2>::value,"Cannot assign quantities with different dimensions.");
-			return val = rhs.val;
+			static_assert(E::size==expr::vect_size<T>::value,"Cannot evaluate a vector expression into a vector of a different length.");
+			e.eval_to(val);
+			return *this;
+		}
+
+		template<class Dim2, class E>
+		quantity<Dim,T>& operator+=(const quantity_expr<Dim2,E>& e) {
+			static_assert(std::is_same<Dim,Dim2>::value,"Cannot add quantities with different dimensions.");
+			static_assert(E::size==expr::vect_size<T>::value,"Cannot evaluate a vector expression into a vector of a different length.");
+			e.add_to(val);
+			return *this;
+		}
+
+		template<class Dim2, class E>
+		quantity<Dim,T>& operator-=(const quantity_expr<Dim2,E>& e) {
+			static_assert(std::is_same<Dim,Dim2>::value,"Cannot subtract quantities with different dimensions.");
+			static_assert(E::size==expr::vect_size<T>::value,"Cannot evaluate a vector expression into a vector of a different length.");
+			e.sub_to(val);
+			return *this;
 		}
 
 		// template alias for return type and new dimensions
@@ -93,29 +232,29 @@ namespace dims {
 		 * in a quantity with the correct type and dimensions before returning.
 		 */
 		template<class Dim2, class T2>
-		quantity<new_dim<Dim2>,mult_type<T2>> operator* (quantity<Dim2,T2> rhs) const {
-			return quantity<new_dim<Dim2>,mult_type<T2>>(val*rhs.val);
+		constexpr quantity<new_dim<Dim2>,mult_type<T2>> operator* (quantity<Dim2,T2> rhs) const {
+			return quantity<new_dim<Dim2>,mult_type<T2>>(DIMS_OBSERVE(mul,val*rhs.val,(val,rhs.val),new_dim<Dim2>));
 		}
 
 		template<class Dim2, class T2>
-		quantity<new_dim<typename inv_Dimension<Dim2>::result>,div_type<T2>> operator/(quantity<Dim2,T2> rhs) const {
-			return quantity<new_dim<typename inv_Dimension<Dim2>::result>,div_type<T2>>(val/rhs.val);
+		constexpr quantity<new_dim<typename inv_Dimension<Dim2>::result>,div_type<T2>> operator/(quantity<Dim2,T2> rhs) const {
+			return quantity<new_dim<typename inv_Dimension<Dim2>::result>,div_type<T2>>(DIMS_OBSERVE(div,val/rhs.val,(val,rhs.val),new_dim<typename inv_Dimension<Dim2>::result>));
 		}
 
 		/*
 		 * We can only multiply-assign and divide-assign by dimensionless numbers
 		 */
 		template<class Dim2, class T2>
-		quantity<Dim,T>& operator*=(quantity<Dim2,T2> rhs) {
+		constexpr quantity<Dim,T>& operator*=(quantity<Dim2,T2> rhs) {
 			static_assert(std::is_same<Dim2,typename make_list_from_type<list_length<Dim>::value,std::ratio<0>>::type>::value,"Can only *= with dimensionless RHS");
-			val *= rhs.val;
+			DIMS_OBSERVE_ASSIGN(mul,val,val *= rhs.val,(val,rhs.val),Dim);
 			return *this;
 		}
 
 		template<class Dim2, class T2>
-		quantity<Dim,T>& operator/=(quantity<Dim2,T2> rhs) {
+		constexpr quantity<Dim,T>& operator/=(quantity<Dim2,T2> rhs) {
 			static_assert(std::is_same<Dim2,typename make_list_from_type<list_length<Dim>::value,std::ratio<0>>::type>::value,"Can only *= with dimensionless RHS");
-			val /= rhs.val;
+			DIMS_OBSERVE_ASSIGN(div,val,val /= rhs.val,(val,rhs.val),Dim);
 			return *this;
 		}
 
@@ -124,55 +263,55 @@ namespace dims {
 		 */
 
 		template<class T2, class T3=decltype(std::declval<T>()+std::declval<T2>())>
-		quantity<Dim,T3> operator+(quantity<Dim,T2> rhs) const {
-			return quantity<Dim,T3>(val+rhs.val);
+		constexpr quantity<Dim,T3> operator+(quantity<Dim,T2> rhs) const {
+			return quantity<Dim,T3>(DIMS_OBSERVE(add,val+rhs.val,(val,rhs.val),Dim));
 		}
 
 		template<class T2, class T3=decltype(std::declval<T>()-std::declval<T2>())>
-		quantity<Dim,T3> operator-(quantity<Dim,T2> rhs) const {
-			return quantity<Dim,T3>(val-rhs.val);
+		constexpr quantity<Dim,T3> operator-(quantity<Dim,T2> rhs) const {
+			return quantity<Dim,T3>(DIMS_OBSERVE(sub,val-rhs.val,(val,rhs.val),Dim));
 		}
 
 		template<class T2>
-		quantity<Dim,T>& operator+=(quantity<Dim,T2> rhs) {
-			val += rhs.val;
+		constexpr quantity<Dim,T>& operator+=(quantity<Dim,T2> rhs) {
+			DIMS_OBSERVE_ASSIGN(add,val,val += rhs.val,(val,rhs.val),Dim);
 			return *this;
 		}
 
 		template<class T2>
-		quantity<Dim,T>& operator-=(quantity<Dim,T2> rhs) {
-			val -= rhs.val;
+		constexpr quantity<Dim,T>& operator-=(quantity<Dim,T2> rhs) {
+			DIMS_OBSERVE_ASSIGN(sub,val,val -= rhs.val,(val,rhs.val),Dim);
 			return *this;
 		}
 
 		// comparison operators
 		template<class T2>
-		bool operator<(quantity<Dim,T2> rhs) const {
+		constexpr bool operator<(quantity<Dim,T2> rhs) const {
 			return val < rhs.val;
 		}
 
 		template<class T2>
-		bool operator<=(quantity<Dim,T2> rhs) const {
+		constexpr bool operator<=(quantity<Dim,T2> rhs) const {
 			return val <= rhs.val;
 		}
 
 		template<class T2>
-		bool operator>(quantity<Dim,T2> rhs) const {
+		constexpr bool operator>(quantity<Dim,T2> rhs) const {
 			return val > rhs.val;
 		}
 
 		template<class T2>
-		bool operator>=(quantity<Dim,T2> rhs) const {
+		constexpr bool operator>=(quantity<Dim,T2> rhs) const {
 			return val >= rhs.val;
 		}
 
 		// for accessing member functions of val
-		T* operator->() {
+		constexpr T* operator->() {
 			return &val;
 		}
 
 		template<typename U=T,typename R=decltype(std::declval<U>().operator[](0))>
-		quantity<Dim,R> operator[](int i) const {
+		constexpr quantity<Dim,R> operator[](int i) const {
 			return quantity<Dim,R>(val[i]);
 		}
 
@@ -182,7 +321,7 @@ namespace dims {
 		}
 
 		// discard dimensional saftey and get the raw value
-		friend T dims::discard_dims(const quantity<Dim,T>& qty) {
+		friend constexpr T discard_dims(const quantity<Dim,T>& qty) {
 			return qty.val;
 		}
 
@@ -190,12 +329,12 @@ namespace dims {
 		 * Wrappers for floor/ceil
 		 */
 
-		friend this_type floor(const this_type& qty) {
-			return this_type(::floor(qty.val));
+		friend constexpr this_type floor(const this_type& qty) {
+			return this_type(DIMS_OBSERVE(round,constexpr_floor(qty.val),(qty.val),Dim));
 		}
 
-		friend this_type ceil(const this_type& qty) {
-			return this_type(::ceil(qty.val));
+		friend constexpr this_type ceil(const this_type& qty) {
+			return this_type(DIMS_OBSERVE(round,constexpr_ceil(qty.val),(qty.val),Dim));
 		}
 
 		/*
@@ -203,19 +342,19 @@ namespace dims {
 		 */
 
 		// square root
-		friend quantity< typename sqrt_Dimension<Dim>::result, T> sqrt(const quantity<Dim,T>& qty) {
-			return quantity<typename sqrt_Dimension<Dim>::result,T>(::sqrt(qty.val));
+		friend constexpr quantity< typename sqrt_Dimension<Dim>::result, T> sqrt(const quantity<Dim,T>& qty) {
+			return quantity<typename sqrt_Dimension<Dim>::result,T>(DIMS_OBSERVE(sqrt,constexpr_sqrt(qty.val),(qty.val),typename sqrt_Dimension<Dim>::result));
 		}
 
 		// raise to a rational power
 		template<typename R> // R must be a type of std::ratio
-		friend quantity< typename pow_Dimension<Dim,R>::result, T> pow(const quantity<Dim,T>& qty) {
-			return quantity<typename pow_Dimension<Dim,R>::result,T>(::pow(qty.val,(double)R::num/(double)R::den));
+		friend constexpr quantity< typename pow_Dimension<Dim,R>::result, T> pow(const quantity<Dim,T>& qty) {
+			return quantity<typename pow_Dimension<Dim,R>::result,T>(DIMS_OBSERVE(pow,constexpr_pow(qty.val,R::num,R::den),(qty.val),typename pow_Dimension<Dim,R>::result));
 		}
 
 		template<intmax_t A>
-		friend quantity< typename pow_Dimension<Dim,std::ratio<A>>::result,T> pow(const quantity<Dim,T>& qty) {
-			return quantity<typename pow_Dimension<Dim,std::ratio<A>>::result,T>(::pow(qty.val,(double)A));
+		friend constexpr quantity< typename pow_Dimension<Dim,std::ratio<A>>::result,T> pow(const quantity<Dim,T>& qty) {
+			return quantity<typename pow_Dimension<Dim,std::ratio<A>>::result,T>(DIMS_OBSERVE(pow,constexpr_pow(qty.val,A,1),(qty.val),typename pow_Dimension<Dim,std::ratio<A>>::result));
 		}
 
 
@@ -225,11 +364,37 @@ namespace dims {
 
 	/*
 	 * Some common dimensions and dimensional quantities.
+	 *
+	 * The base dimensions are the seven SI bases, in the order mass, length,
+	 * time, temperature, amount of substance, electric current and luminous
+	 * intensity. Defining DIMS_ANGLE_DIMENSION adds plane angle as an eighth
+	 * base (solid angle is angle squared), so that e.g. angular velocity and
+	 * frequency become different dimensions. It must be defined the same way
+	 * in every translation unit.
 	 */
 
-	// convenience using-statement for generating dimensions with integer powers
+#if defined(DIMS_ANGLE_DIMENSION)
+	constexpr int base_dimensions = 8;
+#else
+	constexpr int base_dimensions = 7;
+#endif
+
+	// append N zero exponents to a dimension
+	template<class Dim, int N>
+	struct pad_Dimension {
+		static_assert(N>=0,"Too many exponents for the number of base dimensions");
+		using result = typename pad_Dimension<typename push_back<Dim,std::ratio<0>>::type,N-1>::result;
+	};
+
+	template<class Dim>
+	struct pad_Dimension<Dim,0> {
+		using result = Dim;
+	};
+
+	// convenience using-statement for generating dimensions with integer powers,
+	// trailing zero exponents may be left out (e.g. IntDim<0,1,-1> is a velocity)
 	template<int... Is>
-	using IntDim = Dimension<std::ratio<Is>...>;
+	using IntDim = typename pad_Dimension<Dimension<std::ratio<Is>...>,base_dimensions-(int)sizeof...(Is)>::result;
 
 	// basic dimension typedefs
 	typedef IntDim<0,0,0>	number;
@@ -249,6 +414,25 @@ namespace dims {
 	typedef IntDim<1,-3,0>  density;
 	typedef IntDim<0,-3,0>  number_density;
 	typedef IntDim<1,-1,-1> viscosity; // dynamic
+	typedef IntDim<1,2,-3>	power;
+	typedef IntDim<0,0,0,1>	temperature;
+	typedef IntDim<0,0,0,0,1>	amount;
+	typedef IntDim<0,0,0,0,0,1>	current;
+	typedef IntDim<0,0,0,0,0,0,1>	luminous_intensity;
+	typedef IntDim<0,0,1,0,0,1>	charge;
+	typedef IntDim<1,2,-3,0,0,-1>	voltage;
+	typedef IntDim<1,2,-2,-1>	entropy; // also heat capacity
+	typedef IntDim<1,0,0,0,-1>	molar_mass;
+	typedef IntDim<0,-3,0,0,1>	concentration;
+#if defined(DIMS_ANGLE_DIMENSION)
+	typedef IntDim<0,0,0,0,0,0,0,1>	angle;
+	typedef IntDim<0,0,0,0,0,0,0,2>	solid_angle;
+	typedef IntDim<0,0,-1,0,0,0,0,1>	angular_velocity;
+#else
+	typedef number	angle;
+	typedef number	solid_angle;
+	typedef frequency	angular_velocity;
+#endif
 
 #define CQ_IMPL(a) template<typename T=double> using a ## _ ## t = quantity<a,T>;
 
@@ -265,6 +449,16 @@ namespace dims {
 	CQ_IMPL(area)
 	CQ_IMPL(volume)
 	CQ_IMPL(frequency)
+	CQ_IMPL(power)
+	CQ_IMPL(temperature)
+	CQ_IMPL(amount)
+	CQ_IMPL(current)
+	CQ_IMPL(luminous_intensity)
+	CQ_IMPL(charge)
+	CQ_IMPL(voltage)
+	CQ_IMPL(entropy)
+	CQ_IMPL(angle)
+	CQ_IMPL(angular_velocity)
 
 #define UDL_IMPL(a) constexpr quantity<a,double> operator"" _ ## a (long double d) { return quantity<a,double>(d); };
 
@@ -281,6 +475,13 @@ namespace dims {
 	UDL_IMPL(area)
 	UDL_IMPL(volume)
 	UDL_IMPL(frequency)
+	UDL_IMPL(power)
+	UDL_IMPL(temperature)
+	UDL_IMPL(amount)
+	UDL_IMPL(current)
+	UDL_IMPL(charge)
+	UDL_IMPL(voltage)
+	UDL_IMPL(angle)
 
 	/*
 	 * Definitions of some useful numbers
@@ -0,0 +1,240 @@
+#ifndef DUAL_HPP_
+#define DUAL_HPP_
+
+#include <cmath>
+#include <cstddef>
+#include <iostream>
+#include <type_traits>
+#include <utility>
+
+#include "dims.hpp"
+#include "vect.hpp"
+
+/*
+ * Forward-mode automatic differentiation. dual<T,N> holds a value and its
+ * derivatives with respect to N independent variables, stored contiguously
+ * as an nvect<N,T> so the derivative lanes go through the (SIMD) nvect
+ * kernels. It is a plain value type, so quantity<Dim,dual<T,N>> and
+ * nvect<M,dual<T,N>> work like any other quantity or vector:
+ *
+ *     auto x = dims::seed<0,2>(length_t<>(2.0));
+ *     auto y = dims::seed<1,2>(length_t<>(3.0));
+ *     auto r = sqrt(x*x + y*y);
+ *     quantity<number> drdx = dims::derivative<0>(r,x); // x/r
+ *
+ * A derivative of a quantity<D> with respect to a quantity<Dwrt> has
+ * dimensions D/Dwrt, so one evaluation gives the value and the gradient.
+ */
+
+template<typename T, size_t N>
+class dual {
+
+	static_assert(N>0,"Cannot create dual<T,N> with N<1");
+	using this_type = dual<T,N>;
+
+public:
+	typedef T value_type;
+	typedef nvect<N,T> gradient_type;
+
+	static constexpr size_t size() { return N; }
+
+	// trivial so that dual() zero initialises like a double
+	dual() 								= default;
+	dual(const this_type&) 				= default;
+	dual(this_type&&) 					= default;
+	~dual() 							= default;
+	this_type& operator=(const this_type&) 	= default;
+	this_type& operator=(this_type&&) 		= default;
+
+	// a constant, all derivatives are zero
+	dual(T v) :v(v), d() {}
+
+	dual(T v, const gradient_type& d) :v(v), d(d) {}
+
+	// the I-th independent variable
+	template<size_t I>
+	static this_type variable(T v) {
+		static_assert(I<N,"Variable index out of range");
+		this_type out(v);
+		out.d[I] = T(1);
+		return out;
+	}
+
+	T value() const { return v; }
+	const gradient_type& gradient() const { return d; }
+	T derivative(size_t i) const { return d[i]; }
+
+	/*
+	 * Arithmetic, each is the chain rule applied to the value
+	 */
+
+	this_type operator-() const {
+		return this_type(-v,d*T(-1));
+	}
+
+	this_type operator+(const this_type& rhs) const {
+		return this_type(v+rhs.v,d+rhs.d);
+	}
+
+	this_type operator-(const this_type& rhs) const {
+		return this_type(v-rhs.v,d-rhs.d);
+	}
+
+	this_type operator*(const this_type& rhs) const {
+		return this_type(v*rhs.v,d*rhs.v + rhs.d*v);
+	}
+
+	this_type operator/(const this_type& rhs) const {
+		const T inv = T(1)/rhs.v;
+		return this_type(v*inv,(d - rhs.d*(v*inv))*inv);
+	}
+
+	this_type& operator+=(const this_type& rhs) { v += rhs.v; d += rhs.d; return *this; }
+	this_type& operator-=(const this_type& rhs) { v -= rhs.v; d -= rhs.d; return *this; }
+	this_type& operator*=(const this_type& rhs) { return *this = *this*rhs; }
+	this_type& operator/=(const this_type& rhs) { return *this = *this/rhs; }
+
+	// mixed with plain values, which have no derivatives
+	this_type operator+(T s) const { return this_type(v+s,d); }
+	this_type operator-(T s) const { return this_type(v-s,d); }
+	this_type operator*(T s) const { return this_type(v*s,d*s); }
+	this_type operator/(T s) const { return this_type(v/s,d/s); }
+
+	friend this_type operator+(T s, const this_type& x) { return x+s; }
+	friend this_type operator-(T s, const this_type& x) { return this_type(s-x.v,x.d*T(-1)); }
+	friend this_type operator*(T s, const this_type& x) { return x*s; }
+	friend this_type operator/(T s, const this_type& x) {
+		const T inv = T(1)/x.v;
+		return this_type(s*inv,x.d*(-s*inv*inv));
+	}
+
+	this_type& operator+=(T s) { v += s; return *this; }
+	this_type& operator-=(T s) { v -= s; return *this; }
+	this_type& operator*=(T s) { v *= s; d *= s; return *this; }
+	this_type& operator/=(T s) { v /= s; d /= s; return *this; }
+
+	// comparisons only look at the value
+	bool operator< (const this_type& rhs) const { return v <  rhs.v; }
+	bool operator<=(const this_type& rhs) const { return v <= rhs.v; }
+	bool operator> (const this_type& rhs) const { return v >  rhs.v; }
+	bool operator>=(const this_type& rhs) const { return v >= rhs.v; }
+
+	/*
+	 * Maths functions, found by ADL so that quantity's sqrt/pow/floor/ceil
+	 * and nvect::magnitude pick them up.
+	 */
+
+	friend this_type sqrt(const this_type& x) {
+		using std::sqrt;
+		const T s = sqrt(x.v);
+		return this_type(s,x.d*(T(0.5)/s));
+	}
+
+	friend this_type pow(const this_type& x, T p) {
+		using std::pow;
+		const T y = pow(x.v,p);
+		if(x.v!=T(0))
+			return this_type(y,x.d*(p*pow(x.v,p-T(1))));
+
+		// at zero p*v^(p-1) is 0 (p==0 or p>1), 1 (p==1) or infinite
+		// (p<1), and lanes that do not depend on x must stay 0 not 0*inf
+		const T dy = p==T(0) ? T(0) : p*pow(x.v,p-T(1));
+		gradient_type g = gradient_type();
+		for(size_t i=0; i<N; ++i)
+			if(x.d[i]!=T(0))
+				g[i] = x.d[i]*dy;
+		return this_type(y,g);
+	}
+
+	friend this_type exp(const this_type& x) {
+		using std::exp;
+		const T e = exp(x.v);
+		return this_type(e,x.d*e);
+	}
+
+	friend this_type log(const this_type& x) {
+		using std::log;
+		return this_type(log(x.v),x.d/x.v);
+	}
+
+	friend this_type sin(const this_type& x) {
+		using std::sin; using std::cos;
+		return this_type(sin(x.v),x.d*cos(x.v));
+	}
+
+	friend this_type cos(const this_type& x) {
+		using std::sin; using std::cos;
+		return this_type(cos(x.v),x.d*(-sin(x.v)));
+	}
+
+	friend this_type abs(const this_type& x) {
+		return x.v<T(0) ? -x : x;
+	}
+
+	// piecewise constant, so the derivatives are zero
+	friend this_type floor(const this_type& x) {
+		using std::floor;
+		return this_type(floor(x.v));
+	}
+
+	friend this_type ceil(const this_type& x) {
+		using std::ceil;
+		return this_type(ceil(x.v));
+	}
+
+	friend std::ostream& operator<<(std::ostream& out, const this_type& x) {
+		return out << x.v << " + " << x.d << "e";
+	}
+
+private:
+	T v;
+	gradient_type d;
+};
+
+namespace dims {
+
+	// x as the I-th of N independent variables
+	template<size_t I, size_t N, class Dim, class T>
+	quantity<Dim,dual<T,N>> seed(const quantity<Dim,T>& x) {
+		return quantity<Dim,dual<T,N>>(dual<T,N>::template variable<I>(discard_dims(x)));
+	}
+
+	// a vector x as the variables I..I+M-1 of N
+	template<size_t I, size_t N, class Dim, size_t M, class T>
+	quantity<Dim,nvect<M,dual<T,N>>> seed(const quantity<Dim,nvect<M,T>>& x) {
+		static_assert(I+M<=N,"Not enough derivative lanes for the vector");
+		const nvect<M,T> raw = discard_dims(x);
+		nvect<M,dual<T,N>> out;
+		for(size_t k=0; k<M; ++k) {
+			nvect<N,T> d = nvect<N,T>();
+			d[I+k] = T(1);
+			out[k] = dual<T,N>(raw[k],d);
+		}
+		return quantity<Dim,nvect<M,dual<T,N>>>(out);
+	}
+
+	// the value without derivatives
+	template<class Dim, class T, size_t N>
+	quantity<Dim,T> primal(const quantity<Dim,dual<T,N>>& y) {
+		return quantity<Dim,T>(discard_dims(y).value());
+	}
+
+	// dy/dx_I, where x_I has dimensions DimWrt
+	template<size_t I, class DimWrt, class Dim, class T, size_t N>
+	quantity<typename mult_Dimension<Dim,typename inv_Dimension<DimWrt>::result>::result,T>
+	derivative(const quantity<Dim,dual<T,N>>& y) {
+		static_assert(I<N,"Variable index out of range");
+		using result_dim = typename mult_Dimension<Dim,typename inv_Dimension<DimWrt>::result>::result;
+		return quantity<result_dim,T>(discard_dims(y).derivative(I));
+	}
+
+	// as above, taking the dimensions from the seeded variable x
+	template<size_t I, class Dim, class T, size_t N, class DimWrt, class U>
+	quantity<typename mult_Dimension<Dim,typename inv_Dimension<DimWrt>::result>::result,T>
+	derivative(const quantity<Dim,dual<T,N>>& y, const quantity<DimWrt,U>&) {
+		return derivative<I,DimWrt>(y);
+	}
+
+}; // namespace dims
+
+#endif /* DUAL_HPP_ */
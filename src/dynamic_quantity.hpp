@@ -0,0 +1,284 @@
+#ifndef DYNAMIC_QUANTITY_HPP_
+#define DYNAMIC_QUANTITY_HPP_
+
+#include "dims.hpp"
+
+#include <cstdint>
+#include <cstdlib>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+/*
+ * Quantities whose dimensions are only known at runtime, for use at the
+ * edges of a program (configuration, file formats, plugin interfaces).
+ *
+ * The exponents are packed into a single 64 bit word, one signed byte per
+ * base dimension (up to 8), each holding the exponent multiplied by a fixed
+ * denominator of 12. This represents all the halves, thirds, quarters and
+ * sixths that can come from sqrt/pow, in the range [-10,10], and because
+ * the encoding is canonical, comparing dimensions is one integer compare
+ * and multiplying/dividing them is a single SWAR (lane-wise) add/subtract.
+ *
+ * quantity_cast<Dim>() converts back to a static quantity<Dim,T>, checking
+ * the dimensions once so that nothing is checked in the code using it:
+ *
+ *     dynamic_quantity<> d = read_setting("dt");
+ *     dims::time_t<> dt = quantity_cast<dims::time>(d); // throws dimension_error if d is not a time
+ */
+
+namespace dims {
+
+	// thrown on a runtime dimension mismatch
+	struct dimension_error : std::runtime_error {
+		using std::runtime_error::runtime_error;
+	};
+
+	/*
+	 * Packed dimension exponents.
+	 */
+	class dynamic_dimension {
+	public:
+		static constexpr int denominator = 12;
+		static constexpr size_t max_base_dims = 8;
+
+		constexpr dynamic_dimension() :bits(0) {}
+		constexpr explicit dynamic_dimension(uint64_t bits) :bits(bits) {}
+
+		constexpr uint64_t code() const { return bits; }
+
+		// exponent of base dimension i, multiplied by denominator
+		constexpr int lane(size_t i) const {
+			return (int8_t)(uint8_t)(bits >> 8*i);
+		}
+
+		constexpr bool dimensionless() const { return bits==0; }
+
+		constexpr bool operator==(dynamic_dimension rhs) const { return bits==rhs.bits; }
+		constexpr bool operator!=(dynamic_dimension rhs) const { return bits!=rhs.bits; }
+
+		// product of dimensions, i.e. the sum of the exponents
+		friend dynamic_dimension operator*(dynamic_dimension a, dynamic_dimension b) {
+			const uint64_t s = ((a.bits & ~high) + (b.bits & ~high)) ^ ((a.bits ^ b.bits) & high);
+			// a lane overflows if both inputs have the same sign and the result does not
+			if((a.bits ^ s) & (b.bits ^ s) & high)
+				throw dimension_error("dynamic_dimension: exponent out of range");
+			return dynamic_dimension(s);
+		}
+
+		// quotient of dimensions, i.e. the difference of the exponents
+		friend dynamic_dimension operator/(dynamic_dimension a, dynamic_dimension b) {
+			const uint64_t d = ((a.bits | high) - (b.bits & ~high)) ^ ((a.bits ^ ~b.bits) & high);
+			// a lane overflows if the inputs have different signs and the result has b's sign
+			if((a.bits ^ b.bits) & (a.bits ^ d) & high)
+				throw dimension_error("dynamic_dimension: exponent out of range");
+			return dynamic_dimension(d);
+		}
+
+		friend dynamic_dimension inverse(dynamic_dimension a) {
+			return dynamic_dimension() / a;
+		}
+
+		// halve every exponent (an arithmetic shift of each lane)
+		friend dynamic_dimension sqrt(dynamic_dimension a) {
+			if(a.bits & low)
+				throw dimension_error("dynamic_dimension: exponent not representable after sqrt");
+			return dynamic_dimension(((a.bits >> 1) & ~high) | (a.bits & high));
+		}
+
+		// raise to an integer power
+		friend dynamic_dimension pow(dynamic_dimension a, int n) {
+			dynamic_dimension out;
+			const dynamic_dimension b = n<0 ? inverse(a) : a;
+			for(int i=0; i<std::abs(n); ++i)
+				out = out*b;
+			return out;
+		}
+
+		// e.g. "<1,-2,1/2>" for the first base_dims exponents
+		std::string to_string(size_t base_dims) const {
+			std::string out = "<";
+			for(size_t i=0; i<base_dims; ++i) {
+				int num = lane(i), den = denominator;
+				const int g = gcd(num<0 ? -num : num,den);
+				num /= g;
+				den /= g;
+				if(i>0)
+					out += ",";
+				out += std::to_string(num);
+				if(den!=1)
+					out += "/" + std::to_string(den);
+			}
+			return out + ">";
+		}
+
+	private:
+		static constexpr uint64_t high = 0x8080808080808080ull;
+		static constexpr uint64_t low  = 0x0101010101010101ull;
+
+		static int gcd(int a, int b) {
+			return b==0 ? a : gcd(b,a%b);
+		}
+
+		uint64_t bits;
+	};
+
+	/*
+	 * The packed encoding of a static dimension, computed at compile time.
+	 */
+	template<class Dim, size_t I=0>
+	struct dim_code {
+		using R = typename Dim::value;
+		static_assert(I<dynamic_dimension::max_base_dims,"Too many base dimensions for dynamic_dimension");
+		static_assert((R::num*dynamic_dimension::denominator)%R::den==0,"Exponent is not a multiple of 1/12");
+		static constexpr intmax_t lane = R::num*dynamic_dimension::denominator/R::den;
+		static_assert(lane>=-128 && lane<=127,"Exponent out of range for dynamic_dimension");
+
+		static constexpr uint64_t value = (uint64_t)(uint8_t)(int8_t)lane << 8*I | dim_code<typename Dim::tail,I+1>::value;
+	};
+
+	template<size_t I>
+	struct dim_code<lists::end_element,I> {
+		static constexpr uint64_t value = 0;
+	};
+
+	template<class Dim>
+	constexpr dynamic_dimension dimension_of() {
+		return dynamic_dimension(dim_code<Dim>::value);
+	}
+
+	/*
+	 * A value together with its runtime dimensions. Arithmetic checks the
+	 * dimensions where the static quantity would not compile, and throws
+	 * dimension_error.
+	 */
+	template<class T=double>
+	struct dynamic_quantity {
+
+		typedef T value_type;
+		typedef dynamic_quantity<T> this_type;
+
+		dynamic_quantity() :val(), dim() {}
+		dynamic_quantity(T val, dynamic_dimension dim) :val(val), dim(dim) {}
+
+		// from a static quantity, the dimensions are encoded at compile time
+		template<class Dim>
+		dynamic_quantity(const quantity<Dim,T>& q) :val(discard_dims(q)), dim(dimension_of<Dim>()) {}
+
+		dynamic_dimension dimension() const { return dim; }
+		T value() const { return val; }
+
+		template<class Dim>
+		bool is() const { return dim==dimension_of<Dim>(); }
+
+		template<class T2, class T3=decltype(std::declval<T>()*std::declval<T2>())>
+		dynamic_quantity<T3> operator*(const dynamic_quantity<T2>& rhs) const {
+			return dynamic_quantity<T3>(val*rhs.value(),dim*rhs.dimension());
+		}
+
+		template<class T2, class T3=decltype(std::declval<T>()/std::declval<T2>())>
+		dynamic_quantity<T3> operator/(const dynamic_quantity<T2>& rhs) const {
+			return dynamic_quantity<T3>(val/rhs.value(),dim/rhs.dimension());
+		}
+
+		template<class T2, class T3=decltype(std::declval<T>()+std::declval<T2>())>
+		dynamic_quantity<T3> operator+(const dynamic_quantity<T2>& rhs) const {
+			check(rhs.dimension(),"add");
+			return dynamic_quantity<T3>(val+rhs.value(),dim);
+		}
+
+		template<class T2, class T3=decltype(std::declval<T>()-std::declval<T2>())>
+		dynamic_quantity<T3> operator-(const dynamic_quantity<T2>& rhs) const {
+			check(rhs.dimension(),"subtract");
+			return dynamic_quantity<T3>(val-rhs.value(),dim);
+		}
+
+		template<class T2>
+		this_type& operator+=(const dynamic_quantity<T2>& rhs) {
+			check(rhs.dimension(),"add");
+			val += rhs.value();
+			return *this;
+		}
+
+		template<class T2>
+		this_type& operator-=(const dynamic_quantity<T2>& rhs) {
+			check(rhs.dimension(),"subtract");
+			val -= rhs.value();
+			return *this;
+		}
+
+		// comparison operators
+		template<class T2>
+		bool operator==(const dynamic_quantity<T2>& rhs) const {
+			return dim==rhs.dimension() && val==rhs.value();
+		}
+
+		template<class T2>
+		bool operator!=(const dynamic_quantity<T2>& rhs) const {
+			return !(*this==rhs);
+		}
+
+		template<class T2>
+		bool operator<(const dynamic_quantity<T2>& rhs) const {
+			check(rhs.dimension(),"compare");
+			return val < rhs.value();
+		}
+
+		template<class T2>
+		bool operator<=(const dynamic_quantity<T2>& rhs) const {
+			check(rhs.dimension(),"compare");
+			return val <= rhs.value();
+		}
+
+		template<class T2>
+		bool operator>(const dynamic_quantity<T2>& rhs) const {
+			check(rhs.dimension(),"compare");
+			return val > rhs.value();
+		}
+
+		template<class T2>
+		bool operator>=(const dynamic_quantity<T2>& rhs) const {
+			check(rhs.dimension(),"compare");
+			return val >= rhs.value();
+		}
+
+		friend this_type sqrt(const this_type& q) {
+			return this_type(::sqrt(q.val),sqrt(q.dim));
+		}
+
+		friend this_type pow(const this_type& q, int n) {
+			return this_type(::pow(q.val,(double)n),pow(q.dim,n));
+		}
+
+		// prints the value followed by the exponents, e.g. "9.81 <0,1,-2>"
+		friend std::ostream& operator<<(std::ostream& out, const this_type& q) {
+			return out << q.val << " " << q.dim.to_string(list_length<number>::value);
+		}
+
+	private:
+		void check(dynamic_dimension rhs, const char* op) const {
+			if(dim!=rhs)
+				throw dimension_error(std::string("Cannot ") + op + " quantities with dimensions "
+									  + dim.to_string(list_length<number>::value) + " and " + rhs.to_string(list_length<number>::value));
+		}
+
+		T val;
+		dynamic_dimension dim;
+	};
+
+	/*
+	 * Checked conversion back to a static quantity. Throws dimension_error if
+	 * the dimensions do not match, otherwise the result is just the value.
+	 */
+	template<class Dim, class T>
+	quantity<Dim,T> quantity_cast(const dynamic_quantity<T>& q) {
+		if(q.dimension()!=dimension_of<Dim>())
+			throw dimension_error("quantity_cast: dimensions " + q.dimension().to_string(list_length<Dim>::value)
+								  + " do not match " + dimension_of<Dim>().to_string(list_length<Dim>::value));
+		return quantity<Dim,T>(q.value());
+	}
+
+}; // namespace dims
+
+#endif /* DYNAMIC_QUANTITY_HPP_ */
@@ -0,0 +1,481 @@
+#ifndef INSTRUMENT_HPP_
+#define INSTRUMENT_HPP_
+
+// true while a constexpr function is being evaluated at compile time
+#if defined(__cpp_lib_is_constant_evaluated)
+#define DIMS_CONSTANT_EVALUATED() std::is_constant_evaluated()
+#elif defined(__has_builtin)
+#if __has_builtin(__builtin_is_constant_evaluated)
+#define DIMS_CONSTANT_EVALUATED() __builtin_is_constant_evaluated()
+#else
+#define DIMS_CONSTANT_EVALUATED() false
+#endif
+#elif defined(__GNUC__) && __GNUC__>=9
+#define DIMS_CONSTANT_EVALUATED() __builtin_is_constant_evaluated()
+#else
+#define DIMS_CONSTANT_EVALUATED() false
+#endif
+
+/*
+ * Optional instrumentation of quantity and nvect arithmetic, enabled by
+ * defining DIMS_INSTRUMENT (the same way in every translation unit). It
+ *
+ *  - counts operations (and the components they produce) per result dimension,
+ *  - reports the dimension and operation that first turns finite inputs into
+ *    a NaN or Inf, through a replaceable handler, and
+ *  - splits the counts by kernel, named with DIMS_KERNEL(name) scopes.
+ *
+ * Counts are kept in thread local tables and merged by snapshot()/report():
+ *
+ *     void forces(...) {
+ *         DIMS_KERNEL("pair forces");
+ *         ...
+ *     }
+ *     dims::instrument::report(std::cout);
+ *
+ * Without DIMS_INSTRUMENT the hooks below expand to the operator bodies they
+ * wrap and DIMS_KERNEL to nothing, so the generated code is unchanged.
+ * Operators of nvect called from a quantity operator are counted once, under
+ * the quantity's dimension; on their own they are counted under "(raw)".
+ * Lazy expressions (quantity_expr.hpp) work on raw values and are not counted.
+ */
+
+#if !defined(DIMS_INSTRUMENT)
+
+#define DIMS_OBSERVE(kind,expr,args,...) (expr)
+#define DIMS_OBSERVE_ASSIGN(kind,lhs,stmt,args,...) stmt
+#define DIMS_KERNEL(name)
+
+#else
+
+#include "lists.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <ratio>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// hooks used in the operators: kind is an operation, args the parenthesised inputs
+#define DIMS_OBSERVE(kind,expr,args,...) \
+	::dims::instrument::observe<__VA_ARGS__>(::dims::instrument::operation::kind,[&]{ return expr; },::dims::instrument::finite_inputs args)
+#define DIMS_OBSERVE_ASSIGN(kind,lhs,stmt,args,...) \
+	::dims::instrument::observe_assign<__VA_ARGS__>(::dims::instrument::operation::kind,lhs,[&]{ stmt; },::dims::instrument::finite_inputs args)
+#define DIMS_KERNEL(name) \
+	const ::dims::instrument::kernel_scope dims_kernel_scope_(name)
+
+template<size_t N, typename T> class nvect;
+template<typename T, size_t N> class dual;
+
+namespace dims {
+
+	namespace instrument {
+
+		enum class operation : unsigned { add, sub, mul, div, dot, sqrt, pow, round };
+
+		constexpr size_t operation_count = 8;
+		constexpr size_t max_dimensions = 256;   // further dimensions share the last slot
+		constexpr size_t max_kernels = 64;       // further kernels share the last slot
+
+		inline const char* operation_name(operation op) {
+			static const char* names[operation_count] = {"add","sub","mul","div","dot","sqrt","pow","round"};
+			return names[(unsigned)op];
+		}
+
+		/*
+		 * Finiteness and component count of a value type. Types not listed are
+		 * one component and never flagged.
+		 */
+
+		template<class T, class Enable=void>
+		struct value_traits {
+			static constexpr size_t components = 1;
+			static bool finite(const T&) { return true; }
+		};
+
+		template<class T>
+		struct value_traits<T,typename std::enable_if<std::is_floating_point<T>::value>::type> {
+			static constexpr size_t components = 1;
+			static bool finite(T x) { return std::isfinite(x); }
+		};
+
+		template<size_t N, class T>
+		struct value_traits<nvect<N,T>> {
+			static constexpr size_t components = N*value_traits<T>::components;
+			static bool finite(const nvect<N,T>& x) {
+				for(size_t i=0; i<N; ++i)
+					if(!value_traits<T>::finite(x[i]))
+						return false;
+				return true;
+			}
+		};
+
+		template<class T, size_t N>
+		struct value_traits<dual<T,N>> {
+			static constexpr size_t components = N+1;
+			static bool finite(const dual<T,N>& x) {
+				return value_traits<T>::finite(x.value()) && value_traits<nvect<N,T>>::finite(x.gradient());
+			}
+		};
+
+		template<class... Ts>
+		constexpr bool finite_inputs(const Ts&... xs) {
+			if(DIMS_CONSTANT_EVALUATED())
+				return true;
+			return (true && ... && value_traits<Ts>::finite(xs));
+		}
+
+		/*
+		 * Dimension and kernel names, registered on first use.
+		 */
+
+		namespace instrument_impl {
+
+			template<class Dim>
+			struct exponents {
+				static std::string get() {
+					using R = typename Dim::value;
+					std::string out = std::to_string(R::num);
+					if(R::den!=1)
+						out += "/" + std::to_string(R::den);
+					const std::string rest = exponents<typename Dim::tail>::get();
+					return rest.empty() ? out : out + "," + rest;
+				}
+			};
+
+			template<>
+			struct exponents<lists::end_element> {
+				static std::string get() { return ""; }
+			};
+
+			class registry {
+			public:
+				registry(size_t capacity, const char* first) :capacity(capacity), names(1,first) {}
+
+				// id of name, added if new
+				unsigned id(const std::string& name) {
+					std::lock_guard<std::mutex> lock(mutex);
+					for(size_t i=0; i<names.size(); ++i)
+						if(names[i]==name)
+							return (unsigned)std::min(i,capacity-1);
+					names.push_back(name);
+					return (unsigned)std::min(names.size()-1,capacity-1);
+				}
+
+				std::string name(unsigned id) {
+					std::lock_guard<std::mutex> lock(mutex);
+					return id==capacity-1 && names.size()>capacity ? std::string("(other)") : names[id];
+				}
+
+			private:
+				std::mutex mutex;
+				size_t capacity;
+				std::vector<std::string> names;
+			};
+
+			inline registry& dimensions() {
+				static registry r(max_dimensions,"(raw)");
+				return r;
+			}
+
+			inline registry& kernels() {
+				static registry r(max_kernels,"(none)");
+				return r;
+			}
+
+			/*
+			 * Counters of one kernel on one thread. Only the owning thread writes
+			 * them, but other threads read them for reports, hence the relaxed
+			 * atomics (plain loads and stores on common hardware).
+			 */
+			struct counter {
+				std::atomic<uint64_t> ops{0}, components{0}, nonfinite{0};
+			};
+
+			using kernel_counts = std::array<std::array<counter,operation_count>,max_dimensions>;
+
+			inline uint64_t bump(std::atomic<uint64_t>& c, uint64_t n) {
+				const uint64_t v = c.load(std::memory_order_relaxed)+n;
+				c.store(v,std::memory_order_relaxed);
+				return v;
+			}
+
+			struct thread_counts;
+
+			// the live thread tables, and the totals of threads that have exited
+			struct global_counts {
+				std::mutex mutex;
+				std::vector<thread_counts*> live;
+				std::array<std::unique_ptr<kernel_counts>,max_kernels> retired;
+			};
+
+			inline global_counts& global() {
+				static global_counts g;
+				return g;
+			}
+
+			struct thread_counts {
+				std::array<std::atomic<kernel_counts*>,max_kernels> kernels;
+
+				thread_counts() {
+					for(auto& k : kernels)
+						k.store(nullptr,std::memory_order_relaxed);
+					std::lock_guard<std::mutex> lock(global().mutex);
+					global().live.push_back(this);
+				}
+
+				~thread_counts() {
+					global_counts& g = global();
+					std::lock_guard<std::mutex> lock(g.mutex);
+					g.live.erase(std::find(g.live.begin(),g.live.end(),this));
+					for(size_t k=0; k<max_kernels; ++k) {
+						std::unique_ptr<kernel_counts> mine(kernels[k].load(std::memory_order_relaxed));
+						if(!mine)
+							continue;
+						if(!g.retired[k])
+							g.retired[k].reset(new kernel_counts());
+						for(size_t d=0; d<max_dimensions; ++d)
+							for(size_t o=0; o<operation_count; ++o) {
+								const counter& c = (*mine)[d][o];
+								counter& r = (*g.retired[k])[d][o];
+								bump(r.ops,c.ops.load(std::memory_order_relaxed));
+								bump(r.components,c.components.load(std::memory_order_relaxed));
+								bump(r.nonfinite,c.nonfinite.load(std::memory_order_relaxed));
+							}
+					}
+				}
+
+				kernel_counts& kernel(unsigned k) {
+					kernel_counts* c = kernels[k].load(std::memory_order_relaxed);
+					if(!c) {
+						c = new kernel_counts();
+						kernels[k].store(c,std::memory_order_release);
+					}
+					return *c;
+				}
+			};
+
+			inline thread_counts& local() {
+				static thread_local thread_counts t;
+				return t;
+			}
+
+			inline unsigned& current_kernel() {
+				static thread_local unsigned k = 0;
+				return k;
+			}
+
+			// > 0 while inside a quantity operator, whose nvect operations are not counted again
+			inline unsigned& depth() {
+				static thread_local unsigned d = 0;
+				return d;
+			}
+
+		} // namespace instrument_impl
+
+		template<class Dim>
+		std::string dimension_name() {
+			return "<" + instrument_impl::exponents<Dim>::get() + ">";
+		}
+
+		template<>
+		inline std::string dimension_name<void>() {
+			return "(raw)";
+		}
+
+		template<class Dim>
+		unsigned dimension_id() {
+			static const unsigned id = instrument_impl::dimensions().id(dimension_name<Dim>());
+			return id;
+		}
+
+		/*
+		 * Non-finite values. The handler is called every time an operation
+		 * with finite inputs produces a NaN or Inf; the default prints the
+		 * first occurrence for each kernel, dimension and operation.
+		 */
+
+		struct nonfinite_event {
+			operation op;
+			std::string dimension;
+			std::string kernel;
+			uint64_t count;      // occurrences so far on this thread, including this one
+		};
+
+		using nonfinite_handler = void(*)(const nonfinite_event&);
+
+		inline void print_first_nonfinite(const nonfinite_event& e) {
+			if(e.count==1)
+				std::cerr << "dims: " << operation_name(e.op) << " produced a non-finite value with dimensions "
+				          << e.dimension << " in kernel " << e.kernel << std::endl;
+		}
+
+		namespace instrument_impl {
+			inline std::atomic<nonfinite_handler>& handler() {
+				static std::atomic<nonfinite_handler> h(&print_first_nonfinite);
+				return h;
+			}
+		} // namespace instrument_impl
+
+		// replace the non-finite handler, returning the previous one
+		inline nonfinite_handler set_nonfinite_handler(nonfinite_handler h) {
+			return instrument_impl::handler().exchange(h);
+		}
+
+		template<class Dim>
+		void record(operation op, size_t components, bool nonfinite) {
+			using namespace instrument_impl;
+			const unsigned k = current_kernel();
+			counter& c = local().kernel(k)[dimension_id<Dim>()][(unsigned)op];
+			bump(c.ops,1);
+			bump(c.components,components);
+			if(nonfinite) {
+				const uint64_t n = bump(c.nonfinite,1);
+				handler().load()(nonfinite_event{op,dimension_name<Dim>(),kernels().name(k),n});
+			}
+		}
+
+		/*
+		 * The hooks. f evaluates the operation, finite is whether all its inputs
+		 * were finite. Nothing is recorded during constant evaluation.
+		 */
+
+		template<class Dim, class F>
+		constexpr auto observe(operation op, F f, bool finite) {
+			if(DIMS_CONSTANT_EVALUATED() || (std::is_void<Dim>::value && instrument_impl::depth()>0))
+				return f();
+			++instrument_impl::depth();
+			auto out = f();
+			--instrument_impl::depth();
+			using V = decltype(out);
+			record<Dim>(op,value_traits<V>::components,finite && !value_traits<V>::finite(out));
+			return out;
+		}
+
+		template<class Dim, class V, class F>
+		constexpr void observe_assign(operation op, const V& lhs, F f, bool finite) {
+			if(DIMS_CONSTANT_EVALUATED() || (std::is_void<Dim>::value && instrument_impl::depth()>0)) {
+				f();
+				return;
+			}
+			++instrument_impl::depth();
+			f();
+			--instrument_impl::depth();
+			record<Dim>(op,value_traits<V>::components,finite && !value_traits<V>::finite(lhs));
+		}
+
+		// operations on this thread are counted under name until the scope ends
+		class kernel_scope {
+		public:
+			explicit kernel_scope(const std::string& name)
+			:previous(instrument_impl::current_kernel()) {
+				instrument_impl::current_kernel() = instrument_impl::kernels().id(name);
+			}
+
+			~kernel_scope() {
+				instrument_impl::current_kernel() = previous;
+			}
+
+			kernel_scope(const kernel_scope&) = delete;
+			kernel_scope& operator=(const kernel_scope&) = delete;
+
+		private:
+			unsigned previous;
+		};
+
+		/*
+		 * Reports. The counts of all threads, live and exited, are summed;
+		 * counts being written at the same time may or may not be included.
+		 */
+
+		struct entry {
+			std::string kernel;
+			std::string dimension;
+			operation op;
+			uint64_t ops, components, nonfinite;
+		};
+
+		// every non-zero count, by kernel then most operations first
+		inline std::vector<entry> snapshot() {
+			using namespace instrument_impl;
+			std::vector<entry> out;
+			global_counts& g = global();
+			std::lock_guard<std::mutex> lock(g.mutex);
+			for(unsigned k=0; k<max_kernels; ++k) {
+				std::vector<const kernel_counts*> tables;
+				if(g.retired[k])
+					tables.push_back(g.retired[k].get());
+				for(thread_counts* t : g.live)
+					if(const kernel_counts* c = t->kernels[k].load(std::memory_order_acquire))
+						tables.push_back(c);
+				if(tables.empty())
+					continue;
+
+				const size_t first = out.size();
+				for(unsigned d=0; d<max_dimensions; ++d)
+					for(unsigned o=0; o<operation_count; ++o) {
+						entry e{std::string(),std::string(),operation(o),0,0,0};
+						for(const kernel_counts* c : tables) {
+							e.ops += (*c)[d][o].ops.load(std::memory_order_relaxed);
+							e.components += (*c)[d][o].components.load(std::memory_order_relaxed);
+							e.nonfinite += (*c)[d][o].nonfinite.load(std::memory_order_relaxed);
+						}
+						if(e.ops==0)
+							continue;
+						e.kernel = kernels().name(k);
+						e.dimension = dimensions().name(d);
+						out.push_back(e);
+					}
+				std::stable_sort(out.begin()+first,out.end(),[](const entry& a, const entry& b) {
+					return a.ops>b.ops;
+				});
+			}
+			return out;
+		}
+
+		inline void report(std::ostream& out) {
+			out << std::left << std::setw(20) << "kernel" << std::setw(28) << "dimensions" << std::setw(8) << "op"
+			    << std::right << std::setw(14) << "ops" << std::setw(14) << "components" << std::setw(10) << "nonfinite" << "\n";
+			for(const entry& e : snapshot())
+				out << std::left << std::setw(20) << e.kernel << std::setw(28) << e.dimension << std::setw(8) << operation_name(e.op)
+				    << std::right << std::setw(14) << e.ops << std::setw(14) << e.components << std::setw(10) << e.nonfinite << "\n";
+		}
+
+		// zero every count (the names stay registered)
+		inline void reset() {
+			using namespace instrument_impl;
+			global_counts& g = global();
+			std::lock_guard<std::mutex> lock(g.mutex);
+			std::vector<kernel_counts*> tables;
+			for(auto& r : g.retired)
+				if(r)
+					tables.push_back(r.get());
+			for(thread_counts* t : g.live)
+				for(auto& k : t->kernels)
+					if(kernel_counts* c = k.load(std::memory_order_acquire))
+						tables.push_back(c);
+			for(kernel_counts* c : tables)
+				for(auto& d : *c)
+					for(counter& o : d) {
+						o.ops.store(0,std::memory_order_relaxed);
+						o.components.store(0,std::memory_order_relaxed);
+						o.nonfinite.store(0,std::memory_order_relaxed);
+					}
+		}
+
+	} // namespace instrument
+
+}; // namespace dims
+
+#endif /* DIMS_INSTRUMENT */
+
+#endif /* INSTRUMENT_HPP_ */
@@ -0,0 +1,415 @@
+#ifndef INTEGRATORS_HPP_
+#define INTEGRATORS_HPP_
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <stdexcept>
+#include <type_traits>
+
+#include "dims.hpp"
+#include "vect.hpp"
+#include "quantity_array.hpp"
+#include "state_vector.hpp"
+
+/*
+ * ODE integrators for states made of quantities: quantity<Dim,T> with T a
+ * scalar or nvect, basic_state_vector and quantity_array.
+ *
+ * The right hand side is a callable f(t,y,dydt) which writes dy/dt into
+ * dydt, whose type is deriv_type<State>, i.e. the state with every
+ * dimension divided by time. A right hand side with the wrong dimensions
+ * does not compile. For the second order methods a(t,x,a) writes the
+ * acceleration, of type deriv_type<deriv_type<Position>>.
+ *
+ * Each stepper owns the workspace for its stages, so stepping allocates
+ * nothing, and each stage combination (e.g. y + h*(a1*k1 + a2*k2 + a3*k3))
+ * is a single fused loop over the raw values of the state.
+ *
+ *     rk4<state_vector<length,velocity>> stepper;
+ *     for(...)
+ *         stepper.step(f,y,t,dt);
+ */
+
+namespace dims {
+
+	/*
+	 * Describes the raw storage of a state type as a number of contiguous
+	 * blocks of scalars, and how to make a state with every dimension
+	 * multiplied by Dim2.
+	 */
+	template<class S>
+	struct state_traits;
+
+	template<class Dim, class T>
+	struct state_traits<quantity<Dim,T>> {
+		static_assert(std::is_arithmetic<T>::value,"Unsupported quantity value type for integration");
+		using scalar_type = T;
+		template<class Dim2> using rescaled = quantity<typename mult_Dimension<Dim,Dim2>::result,T>;
+
+		static size_t blocks(const quantity<Dim,T>&) { return 1; }
+		static size_t block_size(const quantity<Dim,T>&) { return 1; }
+		static T* block(quantity<Dim,T>& q, size_t) { return &q.val; }
+		static const T* block(const quantity<Dim,T>& q, size_t) { return &q.val; }
+		template<class S2> static void match(quantity<Dim,T>&, const S2&) {}
+	};
+
+	template<class Dim, size_t N, class T>
+	struct state_traits<quantity<Dim,nvect<N,T>>> {
+		using scalar_type = T;
+		template<class Dim2> using rescaled = quantity<typename mult_Dimension<Dim,Dim2>::result,nvect<N,T>>;
+
+		static size_t blocks(const quantity<Dim,nvect<N,T>>&) { return 1; }
+		static size_t block_size(const quantity<Dim,nvect<N,T>>&) { return N; }
+		static T* block(quantity<Dim,nvect<N,T>>& q, size_t) { return &q.val[0]; }
+		static const T* block(const quantity<Dim,nvect<N,T>>& q, size_t) { return &q.val[0]; }
+		template<class S2> static void match(quantity<Dim,nvect<N,T>>&, const S2&) {}
+	};
+
+	template<class T, class... Dims>
+	struct state_traits<basic_state_vector<T,Dims...>> {
+		using state = basic_state_vector<T,Dims...>;
+		using scalar_type = T;
+		template<class Dim2> using rescaled = typename state::template scaled_type<Dim2>;
+
+		static size_t blocks(const state&) { return 1; }
+		static size_t block_size(const state&) { return sizeof...(Dims); }
+		static T* block(state& s, size_t) { return s.data(); }
+		static const T* block(const state& s, size_t) { return s.data(); }
+		template<class S2> static void match(state&, const S2&) {}
+	};
+
+	template<class Dim, class T, size_t Align>
+	struct state_traits<quantity_array<Dim,T,Align>> {
+		using state = quantity_array<Dim,T,Align>;
+		using scalar_type = typename state::scalar_type;
+		template<class Dim2> using rescaled = quantity_array<typename mult_Dimension<Dim,Dim2>::result,T,Align>;
+
+		// one block per component
+		static size_t blocks(const state&) { return state::components; }
+		static size_t block_size(const state& s) { return s.size(); }
+		static scalar_type* block(state& s, size_t b) { return s.data(b); }
+		static const scalar_type* block(const state& s, size_t b) { return s.data(b); }
+		template<class S2> static void match(state& s, const S2& like) { s.resize(like.size()); }
+	};
+
+	// the type of d(state)/dt
+	template<class S>
+	using deriv_type = typename state_traits<S>::template rescaled<typename inv_Dimension<time>::result>;
+
+	namespace integrate {
+
+		template<class S>
+		using time_type = quantity<time,typename state_traits<S>::scalar_type>;
+
+		/*
+		 * out = y + h*(c[0]*k[0] + ... + c[K-1]*k[K-1]) in a single pass. The
+		 * derivatives all have the dimensions of y/time. out may be y.
+		 */
+		template<class S, class D, size_t K>
+		void combine(S& out, const S& y, typename state_traits<S>::scalar_type h,
+					 const std::array<typename state_traits<S>::scalar_type,K>& c, const std::array<const D*,K>& k) {
+			using T = typename state_traits<S>::scalar_type;
+			using straits = state_traits<S>;
+			using dtraits = state_traits<D>;
+			static_assert(std::is_same<D,deriv_type<S>>::value,"Stage derivatives must have the dimensions of state/time");
+
+			std::array<T,K> hc;
+			for(size_t j=0; j<K; ++j)
+				hc[j] = h*c[j];
+
+			const size_t n = straits::block_size(y);
+			for(size_t b=0; b<straits::blocks(y); ++b) {
+				T* o = straits::block(out,b);
+				const T* yb = straits::block(y,b);
+				std::array<const T*,K> kb;
+				for(size_t j=0; j<K; ++j)
+					kb[j] = dtraits::block(*k[j],b);
+
+				for(size_t i=0; i<n; ++i) {
+					T acc = hc[0]*kb[0][i];
+					for(size_t j=1; j<K; ++j)
+						acc += hc[j]*kb[j][i];
+					o[i] = yb[i] + acc;
+				}
+			}
+		}
+
+		// out = y + h*k, the K=1 case
+		template<class S, class D>
+		void combine(S& out, const S& y, typename state_traits<S>::scalar_type h, const D& k) {
+			combine<S,D,1>(out,y,h,{{1}},{{&k}});
+		}
+
+		// check the right hand side accepts the derivative type
+		template<class F, class S, class D = deriv_type<S>>
+		void check_rhs() {
+			static_assert(std::is_invocable<F&,const time_type<S>&,const S&,D&>::value,
+						  "Right hand side must be callable as f(t,y,dydt) with dydt of type deriv_type<State> (dimensions of state/time)");
+		}
+
+	}; // namespace integrate
+
+	/*
+	 * Classic fourth order Runge-Kutta.
+	 */
+	template<class State>
+	class rk4 {
+	public:
+		using state_type = State;
+		using deriv = deriv_type<State>;
+		using time_type = integrate::time_type<State>;
+
+		rk4() = default;
+
+		// the workspace is sized for states like y (needed for quantity_array)
+		explicit rk4(const State& y) { resize(y); }
+
+		template<class F>
+		void step(F&& f, State& y, time_type& t, time_type dt) {
+			using T = typename state_traits<State>::scalar_type;
+			integrate::check_rhs<F,State>();
+			resize(y);
+
+			const T h = discard_dims(dt);
+			const time_type half = dt/quantity<number,T>(2);
+
+			f(t,y,k1);
+			integrate::combine(tmp,y,h/2,k1);
+			f(t+half,tmp,k2);
+			integrate::combine(tmp,y,h/2,k2);
+			f(t+half,tmp,k3);
+			integrate::combine(tmp,y,h,k3);
+			f(t+dt,tmp,k4);
+			integrate::combine<State,deriv,4>(y,y,h,{{T(1)/6,T(1)/3,T(1)/3,T(1)/6}},{{&k1,&k2,&k3,&k4}});
+			t += dt;
+		}
+
+	private:
+		void resize(const State& y) {
+			state_traits<State>::match(tmp,y);
+			state_traits<deriv>::match(k1,y);
+			state_traits<deriv>::match(k2,y);
+			state_traits<deriv>::match(k3,y);
+			state_traits<deriv>::match(k4,y);
+		}
+
+		State tmp;
+		deriv k1, k2, k3, k4;
+	};
+
+	/*
+	 * Velocity-Verlet (kick-drift-kick) for x'' = a(t,x). The acceleration at
+	 * the end of each step is kept for the start of the next, so there is
+	 * one evaluation per step; call reset() if x or v are changed between
+	 * steps.
+	 */
+	template<class Position>
+	class velocity_verlet {
+	public:
+		using position_type = Position;
+		using velocity_type = deriv_type<Position>;
+		using acceleration_type = deriv_type<velocity_type>;
+		using time_type = integrate::time_type<Position>;
+
+		velocity_verlet() :have_a(false) {}
+		explicit velocity_verlet(const Position& x) :have_a(false) { resize(x); }
+
+		void reset() { have_a = false; }
+
+		template<class A>
+		void step(A&& accel, Position& x, velocity_type& v, time_type& t, time_type dt) {
+			using T = typename state_traits<Position>::scalar_type;
+			integrate::check_rhs<A,Position,acceleration_type>();
+			resize(x);
+
+			const T h = discard_dims(dt);
+			if(!have_a) {
+				accel(t,x,a);
+				have_a = true;
+			}
+			integrate::combine(v,v,h/2,a);
+			integrate::combine(x,x,h,v);
+			t += dt;
+			accel(t,x,a);
+			integrate::combine(v,v,h/2,a);
+		}
+
+	private:
+		void resize(const Position& x) {
+			state_traits<acceleration_type>::match(a,x);
+		}
+
+		acceleration_type a;
+		bool have_a;
+	};
+
+	/*
+	 * Leapfrog (drift-kick-drift) for x'' = a(t,x), one evaluation per step
+	 * at the half step position.
+	 */
+	template<class Position>
+	class leapfrog {
+	public:
+		using position_type = Position;
+		using velocity_type = deriv_type<Position>;
+		using acceleration_type = deriv_type<velocity_type>;
+		using time_type = integrate::time_type<Position>;
+
+		leapfrog() = default;
+		explicit leapfrog(const Position& x) { resize(x); }
+
+		template<class A>
+		void step(A&& accel, Position& x, velocity_type& v, time_type& t, time_type dt) {
+			using T = typename state_traits<Position>::scalar_type;
+			integrate::check_rhs<A,Position,acceleration_type>();
+			resize(x);
+
+			const T h = discard_dims(dt);
+			integrate::combine(x,x,h/2,v);
+			accel(t+dt/quantity<number,T>(2),x,a);
+			integrate::combine(v,v,h,a);
+			integrate::combine(x,x,h/2,v);
+			t += dt;
+		}
+
+	private:
+		void resize(const Position& x) {
+			state_traits<acceleration_type>::match(a,x);
+		}
+
+		acceleration_type a;
+	};
+
+	/*
+	 * Adaptive fifth order Dormand-Prince (RK45) with an embedded fourth order
+	 * error estimate. The tolerances apply to the raw values of the state, the
+	 * error in each value being scaled by atol + rtol*|y|.
+	 */
+	template<class State>
+	class dormand_prince {
+	public:
+		using state_type = State;
+		using deriv = deriv_type<State>;
+		using time_type = integrate::time_type<State>;
+		using T = typename state_traits<State>::scalar_type;
+
+		explicit dormand_prince(T atol = 1e-8, T rtol = 1e-8) :atol(atol), rtol(rtol), have_k1(false) {}
+		dormand_prince(const State& y, T atol = 1e-8, T rtol = 1e-8) :dormand_prince(atol,rtol) { resize(y); }
+
+		// call if y is changed between steps (the first stage is reused otherwise)
+		void reset() { have_k1 = false; }
+
+		/*
+		 * Attempt a step of dt. On success y and t are advanced and true is
+		 * returned. dt is updated to the suggested size of the next attempt.
+		 */
+		template<class F>
+		bool try_step(F&& f, State& y, time_type& t, time_type& dt) {
+			integrate::check_rhs<F,State>();
+			resize(y);
+
+			const T h = discard_dims(dt);
+			auto at = [&](T c) { return t + dt*quantity<number,T>(c); };
+
+			if(!have_k1) {
+				f(t,y,k1);
+				have_k1 = true;
+			}
+			integrate::combine<State,deriv,1>(tmp,y,h,{{T(1)/5}},{{&k1}});
+			f(at(T(1)/5),tmp,k2);
+			integrate::combine<State,deriv,2>(tmp,y,h,{{T(3)/40,T(9)/40}},{{&k1,&k2}});
+			f(at(T(3)/10),tmp,k3);
+			integrate::combine<State,deriv,3>(tmp,y,h,{{T(44)/45,T(-56)/15,T(32)/9}},{{&k1,&k2,&k3}});
+			f(at(T(4)/5),tmp,k4);
+			integrate::combine<State,deriv,4>(tmp,y,h,{{T(19372)/6561,T(-25360)/2187,T(64448)/6561,T(-212)/729}},{{&k1,&k2,&k3,&k4}});
+			f(at(T(8)/9),tmp,k5);
+			integrate::combine<State,deriv,5>(tmp,y,h,{{T(9017)/3168,T(-355)/33,T(46732)/5247,T(49)/176,T(-5103)/18656}},{{&k1,&k2,&k3,&k4,&k5}});
+			f(t+dt,tmp,k6);
+			integrate::combine<State,deriv,5>(ynew,y,h,{{T(35)/384,T(500)/1113,T(125)/192,T(-2187)/6784,T(11)/84}},{{&k1,&k3,&k4,&k5,&k6}});
+			f(t+dt,ynew,k7);
+
+			// difference between the fifth and fourth order solutions, fused with the error norm
+			const std::array<T,6> e = {{T(71)/57600,T(-71)/16695,T(71)/1920,T(-17253)/339200,T(22)/525,T(-1)/40}};
+			const std::array<const deriv*,6> ke = {{&k1,&k3,&k4,&k5,&k6,&k7}};
+			using straits = state_traits<State>;
+			using dtraits = state_traits<deriv>;
+
+			T sum = 0;
+			size_t count = 0;
+			const size_t n = straits::block_size(y);
+			for(size_t b=0; b<straits::blocks(y); ++b) {
+				const T* yb = straits::block(y,b);
+				const T* nb = straits::block(ynew,b);
+				std::array<const T*,6> kb;
+				for(size_t j=0; j<6; ++j)
+					kb[j] = dtraits::block(*ke[j],b);
+				for(size_t i=0; i<n; ++i) {
+					T err = e[0]*kb[0][i];
+					for(size_t j=1; j<6; ++j)
+						err += e[j]*kb[j][i];
+					const T scale = atol + rtol*std::max(std::abs(yb[i]),std::abs(nb[i]));
+					const T r = h*err/scale;
+					sum += r*r;
+				}
+				count += n;
+			}
+			const T norm = std::sqrt(sum/std::max<size_t>(count,1));
+
+			// standard step size control with a safety factor, limited to [0.2,5]
+			const T grow = norm==0 ? T(5) : std::min(T(5),std::max(T(0.2),T(0.9)*std::pow(norm,T(-0.2))));
+			if(!(norm<=1)) {
+				dt = dt*quantity<number,T>(std::min(grow,T(1)));
+				return false;
+			}
+
+			std::swap(y,ynew);
+			std::swap(k1,k7); // first same as last
+			t += dt;
+			dt = dt*quantity<number,T>(grow);
+			return true;
+		}
+
+		/*
+		 * Integrate from t to t_end starting with step dt, which is updated as
+		 * the integration proceeds. Returns the number of accepted steps.
+		 */
+		template<class F>
+		size_t integrate(F&& f, State& y, time_type& t, time_type t_end, time_type& dt, size_t max_steps = 1000000) {
+			size_t steps = 0;
+			for(size_t attempts=0; t<t_end; ++attempts) {
+				if(attempts==max_steps)
+					throw std::runtime_error("dormand_prince: too many steps");
+				time_type h = t+dt>t_end ? t_end-t : dt;
+				const bool last = !(t+dt<t_end);
+				if(try_step(f,y,t,h)) {
+					++steps;
+					if(last)
+						t = t_end; // avoid round off leaving a tiny final step
+					else
+						dt = h;
+				}
+				else
+					dt = h;
+			}
+			return steps;
+		}
+
+	private:
+		void resize(const State& y) {
+			state_traits<State>::match(tmp,y);
+			state_traits<State>::match(ynew,y);
+			for(deriv* k : {&k1,&k2,&k3,&k4,&k5,&k6,&k7})
+				state_traits<deriv>::match(*k,y);
+		}
+
+		T atol, rtol;
+		bool have_k1;
+		State tmp, ynew;
+		deriv k1, k2, k3, k4, k5, k6, k7;
+	};
+
+}; // namespace dims
+
+#endif /* INTEGRATORS_HPP_ */
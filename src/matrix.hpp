@@ -0,0 +1,275 @@
+#ifndef MATRIX_HPP_
+#define MATRIX_HPP_
+
+#include <iostream>
+#include <ratio>
+#include <type_traits>
+#include <utility>
+
+#include "vect.hpp"
+#include "dims.hpp"
+
+/*
+ * Small fixed size N x M matrices. They are stored as M nvect<N,T> columns
+ * so a matrix-vector product is a sum of scaled columns, which goes through
+ * the (SIMD) nvect kernels, and the loops over columns are unrolled at
+ * compile time. Like nvect they compose with quantity, e.g.
+ *
+ *     quantity<pressure,nmatrix<3,3>> sigma;   // stress tensor
+ *     quantity<area,nvect<3>> dA;
+ *     quantity<force,nvect<3>> F = sigma*dA;
+ */
+
+template<size_t N, size_t M, typename T=double>
+class nmatrix {
+
+	static_assert(N>0 && M>0,"Cannot create nmatrix<N,M,T> with N<1 or M<1");
+	using this_type = nmatrix<N,M,T>;
+
+	template<size_t N2, size_t M2, class U> friend class nmatrix;
+
+public:
+	using column_type = nvect<N,T>;
+
+	// trivial, like nvect
+	nmatrix() 								= default;
+	nmatrix(const this_type&) 				= default;
+	nmatrix(this_type&&) 					= default;
+	~nmatrix() 								= default;
+	this_type& operator=(const this_type&) 	= default;
+	this_type& operator=(this_type&&) 		= default;
+
+	// init from N*M values given in row-major order (as the matrix is written)
+	template<typename U, typename... Us, typename = typename std::enable_if<
+		sizeof...(Us)!=0 || !std::is_same<typename std::decay<U>::type,this_type>::value>::type>
+	nmatrix(U&& u, Us&&... us) {
+		static_assert(sizeof...(Us)==N*M-1,"Not enough args supplied!");
+		const T vs[] = {T(std::forward<U>(u)),T(std::forward<Us>(us))...};
+		for(size_t i=0; i<N; ++i)
+			for(size_t j=0; j<M; ++j)
+				cols[j][i] = vs[i*M+j];
+	}
+
+	static this_type zero() {
+		this_type out;
+		for(auto& c : out.cols)
+			c = make_vect<N,T>(0);
+		return out;
+	}
+
+	static this_type identity() {
+		static_assert(N==M,"Identity matrix must be square");
+		this_type out = zero();
+		for(size_t i=0; i<N; ++i)
+			out.cols[i][i] = T(1);
+		return out;
+	}
+
+	// element access
+	T& operator()(size_t i, size_t j) {
+		return cols[j][i];
+	}
+
+	const T& operator()(size_t i, size_t j) const {
+		return cols[j][i];
+	}
+
+	column_type& column(size_t j) {
+		return cols[j];
+	}
+
+	const column_type& column(size_t j) const {
+		return cols[j];
+	}
+
+	nvect<M,T> row(size_t i) const {
+		nvect<M,T> out;
+		for(size_t j=0; j<M; ++j)
+			out[j] = cols[j][i];
+		return out;
+	}
+
+	/*
+	 * Matrix-vector and matrix-matrix products
+	 */
+
+	template<typename U>
+	nvect<N,decltype(std::declval<T>()*std::declval<U>())>
+	operator* (const nvect<M,U>& vect) const {
+		return product(vect,std::make_index_sequence<M-1>());
+	}
+
+	template<size_t K, typename U>
+	nmatrix<N,K,decltype(std::declval<T>()*std::declval<U>())>
+	operator* (const nmatrix<M,K,U>& mat) const {
+		nmatrix<N,K,decltype(std::declval<T>()*std::declval<U>())> out;
+		for(size_t k=0; k<K; ++k)
+			out.cols[k] = (*this)*mat.cols[k];
+		return out;
+	}
+
+	/*
+	 * Element-wise operations
+	 */
+
+	this_type operator* (T scalar) const {
+		this_type out;
+		for(size_t j=0; j<M; ++j)
+			out.cols[j] = cols[j]*scalar;
+		return out;
+	}
+
+	friend this_type operator* (T scalar, const this_type& mat) {
+		return mat*scalar;
+	}
+
+	this_type operator/ (T scalar) const {
+		this_type out;
+		for(size_t j=0; j<M; ++j)
+			out.cols[j] = cols[j]/scalar;
+		return out;
+	}
+
+	this_type operator+ (const this_type& mat) const {
+		this_type out;
+		for(size_t j=0; j<M; ++j)
+			out.cols[j] = cols[j]+mat.cols[j];
+		return out;
+	}
+
+	this_type operator- (const this_type& mat) const {
+		this_type out;
+		for(size_t j=0; j<M; ++j)
+			out.cols[j] = cols[j]-mat.cols[j];
+		return out;
+	}
+
+	this_type& operator+= (const this_type& mat) {
+		for(size_t j=0; j<M; ++j)
+			cols[j] += mat.cols[j];
+		return *this;
+	}
+
+	this_type& operator-= (const this_type& mat) {
+		for(size_t j=0; j<M; ++j)
+			cols[j] -= mat.cols[j];
+		return *this;
+	}
+
+	this_type& operator*= (T scalar) {
+		for(size_t j=0; j<M; ++j)
+			cols[j] *= scalar;
+		return *this;
+	}
+
+	this_type& operator/= (T scalar) {
+		for(size_t j=0; j<M; ++j)
+			cols[j] /= scalar;
+		return *this;
+	}
+
+	friend nmatrix<M,N,T> transpose(const this_type& mat) {
+		nmatrix<M,N,T> out;
+		for(size_t i=0; i<N; ++i)
+			for(size_t j=0; j<M; ++j)
+				out.cols[i][j] = mat.cols[j][i];
+		return out;
+	}
+
+	friend T trace(const this_type& mat) {
+		static_assert(N==M,"Trace requires a square matrix");
+		T out = mat.cols[0][0];
+		for(size_t i=1; i<N; ++i)
+			out += mat.cols[i][i];
+		return out;
+	}
+
+	/*
+	 * Determinant and inverse of 2x2 and 3x3 matrices, in closed form. The
+	 * inverse of a singular matrix is not checked for (it contains inf/nan).
+	 */
+
+	friend T det(const this_type& mat) {
+		static_assert(N==M && (N==2 || N==3),"det is only implemented for 2x2 and 3x3 matrices");
+		const auto& a = mat;
+		if constexpr(N==2)
+			return a(0,0)*a(1,1) - a(0,1)*a(1,0);
+		else
+			return a(0,0)*(a(1,1)*a(2,2) - a(1,2)*a(2,1))
+				 - a(0,1)*(a(1,0)*a(2,2) - a(1,2)*a(2,0))
+				 + a(0,2)*(a(1,0)*a(2,1) - a(1,1)*a(2,0));
+	}
+
+	friend this_type inverse(const this_type& mat) {
+		static_assert(N==M && (N==2 || N==3),"inverse is only implemented for 2x2 and 3x3 matrices");
+		const auto& a = mat;
+		this_type out;
+		if constexpr(N==2) {
+			out(0,0) =  a(1,1); out(0,1) = -a(0,1);
+			out(1,0) = -a(1,0); out(1,1) =  a(0,0);
+		}
+		else {
+			// the adjugate, i.e. the transposed cofactors
+			out(0,0) = a(1,1)*a(2,2) - a(1,2)*a(2,1);
+			out(0,1) = a(0,2)*a(2,1) - a(0,1)*a(2,2);
+			out(0,2) = a(0,1)*a(1,2) - a(0,2)*a(1,1);
+			out(1,0) = a(1,2)*a(2,0) - a(1,0)*a(2,2);
+			out(1,1) = a(0,0)*a(2,2) - a(0,2)*a(2,0);
+			out(1,2) = a(0,2)*a(1,0) - a(0,0)*a(1,2);
+			out(2,0) = a(1,0)*a(2,1) - a(1,1)*a(2,0);
+			out(2,1) = a(0,1)*a(2,0) - a(0,0)*a(2,1);
+			out(2,2) = a(0,0)*a(1,1) - a(0,1)*a(1,0);
+		}
+		return out/det(mat);
+	}
+
+	friend std::ostream& operator<<(std::ostream& out, const this_type& mat) {
+		out << "(";
+		for(size_t i=0; i<N; ++i)
+			out << (i>0 ? "," : "") << mat.row(i);
+		return out << ")";
+	}
+
+private:
+	// sum of the columns scaled by the vector's components, unrolled
+	template<typename U, size_t... J>
+	nvect<N,decltype(std::declval<T>()*std::declval<U>())>
+	product(const nvect<M,U>& vect, std::index_sequence<J...>) const {
+		nvect<N,decltype(std::declval<T>()*std::declval<U>())> out = cols[0]*vect[0];
+		((out += cols[J+1]*vect[J+1]),...);
+		return out;
+	}
+
+	column_type cols[M];
+};
+
+/*
+ * Wrappers which keep track of the dimensions of matrix quantities (the
+ * products are handled by quantity's operator*).
+ */
+
+namespace dims {
+
+	template<class Dim, size_t N, size_t M, class T>
+	quantity<Dim,nmatrix<M,N,T>> transpose(const quantity<Dim,nmatrix<N,M,T>>& q) {
+		return quantity<Dim,nmatrix<M,N,T>>(transpose(discard_dims(q)));
+	}
+
+	template<class Dim, size_t N, class T>
+	quantity<Dim,T> trace(const quantity<Dim,nmatrix<N,N,T>>& q) {
+		return quantity<Dim,T>(trace(discard_dims(q)));
+	}
+
+	template<class Dim, size_t N, class T>
+	quantity<typename pow_Dimension<Dim,std::ratio<N>>::result,T> det(const quantity<Dim,nmatrix<N,N,T>>& q) {
+		return quantity<typename pow_Dimension<Dim,std::ratio<N>>::result,T>(det(discard_dims(q)));
+	}
+
+	template<class Dim, size_t N, class T>
+	quantity<typename inv_Dimension<Dim>::result,nmatrix<N,N,T>> inverse(const quantity<Dim,nmatrix<N,N,T>>& q) {
+		return quantity<typename inv_Dimension<Dim>::result,nmatrix<N,N,T>>(inverse(discard_dims(q)));
+	}
+
+}; // namespace dims
+
+#endif /* MATRIX_HPP_ */
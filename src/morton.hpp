@@ -0,0 +1,266 @@
+#ifndef MORTON_HPP_
+#define MORTON_HPP_
+
+#include "dims.hpp"
+#include "parallel.hpp"
+#include "vect.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <tuple>
+#include <vector>
+
+/*
+ * Morton (Z-order) reordering of particle arrays. Sorting particles by the
+ * Morton key of their position puts particles that are close in space close
+ * in memory, which restores cache locality in force loops once the order has
+ * drifted:
+ *
+ *     std::vector<uint32_t> perm = morton_reorder(0,x,v,m,f); // x, v, m and f permuted
+ *
+ * The steps are also available separately: bounding_box_of, morton_keys,
+ * radix_sort_permutation and apply_permutation. Arrays can be any container
+ * with size(), operator[] and a value_type, including quantity_array whose
+ * elements are proxies.
+ */
+
+namespace dims {
+
+	template<size_t N, class T=double>
+	struct bounding_box {
+		quantity<position,nvect<N,T>> lo, hi;
+	};
+
+	namespace morton_impl {
+
+		// N and T of a container of quantity<position,nvect<N,T>>
+		template<class P>
+		struct position_traits;
+
+		template<size_t N, class T>
+		struct position_traits<quantity<position,nvect<N,T>>> {
+			static constexpr size_t dimensions = N;
+			using scalar_type = T;
+		};
+
+		template<class Positions>
+		using traits_of = position_traits<typename Positions::value_type>;
+
+		// spread the low 21 bits of x so there are two zero bits between each
+		inline uint64_t spread3(uint64_t x) {
+			x &= 0x1fffff;
+			x = (x | x<<32) & 0x1f00000000ffffULL;
+			x = (x | x<<16) & 0x1f0000ff0000ffULL;
+			x = (x | x<<8)  & 0x100f00f00f00f00fULL;
+			x = (x | x<<4)  & 0x10c30c30c30c30c3ULL;
+			x = (x | x<<2)  & 0x1249249249249249ULL;
+			return x;
+		}
+
+		// spread the low 32 bits of x so there is a zero bit between each
+		inline uint64_t spread2(uint64_t x) {
+			x &= 0xffffffff;
+			x = (x | x<<16) & 0x0000ffff0000ffffULL;
+			x = (x | x<<8)  & 0x00ff00ff00ff00ffULL;
+			x = (x | x<<4)  & 0x0f0f0f0f0f0f0f0fULL;
+			x = (x | x<<2)  & 0x3333333333333333ULL;
+			x = (x | x<<1)  & 0x5555555555555555ULL;
+			return x;
+		}
+
+		template<size_t N>
+		uint64_t interleave(const std::array<uint64_t,N>& c) {
+			if constexpr(N==3) {
+				return spread3(c[0])<<2 | spread3(c[1])<<1 | spread3(c[2]);
+			}
+			else if constexpr(N==2) {
+				return spread2(c[0])<<1 | spread2(c[1]);
+			}
+			else {
+				uint64_t out = 0;
+				for(unsigned b=64/N; b-->0;)
+					for(size_t d=0; d<N; ++d)
+						out = out<<1 | ((c[d]>>b) & 1);
+				return out;
+			}
+		}
+
+		// threads worth using for n elements
+		inline unsigned chunk_threads(size_t n, unsigned threads) {
+			if(threads==0)
+				threads = default_threads();
+			return (unsigned)std::max<size_t>(1,std::min<size_t>(threads,n/4096));
+		}
+
+		// f(tid,lo,hi) over [0,n) in one contiguous chunk per thread
+		template<class F>
+		void chunks(size_t n, unsigned threads, F f) {
+			parallel_run(chunk_threads(n,threads),[&](unsigned tid, unsigned nt) {
+				f(tid,n*tid/nt,n*(tid+1)/nt);
+			});
+		}
+
+		// copy an element out of a container, converting proxies to values
+		template<class A>
+		typename A::value_type load(const A& a, size_t i) {
+			const typename A::value_type v = a[i];
+			return v;
+		}
+
+	} // namespace morton_impl
+
+	// the smallest box containing all the positions
+	template<class Positions>
+	auto bounding_box_of(const Positions& x) {
+		using traits = morton_impl::traits_of<Positions>;
+		constexpr size_t N = traits::dimensions;
+		using T = typename traits::scalar_type;
+		using P = quantity<position,nvect<N,T>>;
+
+		nvect<N,T> lo = make_vect<N,T>(T(0)), hi = lo;
+		for(size_t i=0; i<x.size(); ++i) {
+			const P p = x[i];
+			const nvect<N,T> v = discard_dims(p);
+			for(size_t d=0; d<N; ++d) {
+				lo[d] = i ? std::min(lo[d],v[d]) : v[d];
+				hi[d] = i ? std::max(hi[d],v[d]) : v[d];
+			}
+		}
+		return bounding_box<N,T>{P(lo),P(hi)};
+	}
+
+	/*
+	 * The Morton key of each position, quantised to 64/N bits per direction
+	 * over the box. Positions outside the box are clamped to it.
+	 */
+	template<class Positions, size_t N, class T>
+	void morton_keys(const Positions& x, const bounding_box<N,T>& box, std::vector<uint64_t>& keys, unsigned threads=1) {
+		using P = quantity<position,nvect<N,T>>;
+		constexpr unsigned bits = 64/N;
+		// scale to [0,2^bits], which T holds exactly, then clamp as integers
+		const T top = std::ldexp(T(1),bits);
+		const uint64_t cmax = bits==64 ? ~uint64_t(0) : (uint64_t(1)<<bits)-1;
+		const nvect<N,T> lo = discard_dims(box.lo), hi = discard_dims(box.hi);
+		nvect<N,T> scale;
+		for(size_t d=0; d<N; ++d)
+			scale[d] = hi[d]>lo[d] ? top/(hi[d]-lo[d]) : T(0);
+
+		keys.resize(x.size());
+		morton_impl::chunks(x.size(),threads,[&](unsigned,size_t b,size_t e) {
+			for(size_t i=b; i<e; ++i) {
+				const P p = x[i];
+				const nvect<N,T> v = discard_dims(p);
+				std::array<uint64_t,N> c;
+				for(size_t d=0; d<N; ++d) {
+					const T s = (v[d]-lo[d])*scale[d];
+					c[d] = !(s>T(0)) ? 0 : s>=top ? cmax : std::min(cmax,uint64_t(s));
+				}
+				keys[i] = morton_impl::interleave<N>(c);
+			}
+		});
+	}
+
+	/*
+	 * Stable LSD radix sort of the keys, 8 bits per pass. Returns perm such
+	 * that keys[perm[0]], keys[perm[1]], ... are in order. Each pass counts
+	 * digits per thread and scatters in parallel, and passes where every key
+	 * has the same digit are skipped.
+	 */
+	inline std::vector<uint32_t> radix_sort_permutation(const std::vector<uint64_t>& keys, unsigned threads=1) {
+		const size_t n = keys.size();
+		std::vector<uint64_t> k(keys), k2(n);
+		std::vector<uint32_t> perm(n), perm2(n);
+		for(size_t i=0; i<n; ++i)
+			perm[i] = uint32_t(i);
+
+		const unsigned used = morton_impl::chunk_threads(n,threads);
+		std::vector<std::array<size_t,256>> counts;
+		for(unsigned shift=0; shift<64; shift+=8) {
+			counts.assign(used,std::array<size_t,256>());
+			morton_impl::chunks(n,threads,[&](unsigned tid,size_t b,size_t e) {
+				std::array<size_t,256>& cnt = counts[tid];
+				for(size_t i=b; i<e; ++i)
+					++cnt[(k[i]>>shift) & 0xff];
+			});
+
+			// skip the pass if every key has the same digit
+			size_t nonzero = 0;
+			for(unsigned digit=0; digit<256; ++digit) {
+				size_t total = 0;
+				for(unsigned t=0; t<used; ++t)
+					total += counts[t][digit];
+				nonzero += total>0;
+			}
+			if(nonzero<=1)
+				continue;
+
+			// scatter offsets in (digit,thread) order keep the sort stable
+			size_t sum = 0;
+			for(unsigned digit=0; digit<256; ++digit)
+				for(unsigned t=0; t<used; ++t) {
+					const size_t c = counts[t][digit];
+					counts[t][digit] = sum;
+					sum += c;
+				}
+
+			morton_impl::chunks(n,threads,[&](unsigned tid,size_t b,size_t e) {
+				std::array<size_t,256>& next = counts[tid];
+				for(size_t i=b; i<e; ++i) {
+					const size_t o = next[(k[i]>>shift) & 0xff]++;
+					k2[o] = k[i];
+					perm2[o] = perm[i];
+				}
+			});
+			k.swap(k2);
+			perm.swap(perm2);
+		}
+		return perm;
+	}
+
+	/*
+	 * Reorders every array in place so that element i becomes the old element
+	 * perm[i]. The permutation is applied by following its cycles once, moving
+	 * the elements of all the arrays together, with one temporary per array.
+	 */
+	template<class... Arrays>
+	void apply_permutation(const std::vector<uint32_t>& perm, Arrays&... arrays) {
+		const size_t n = perm.size();
+		std::vector<bool> done(n,false);
+		for(size_t start=0; start<n; ++start) {
+			if(done[start] || perm[start]==start)
+				continue;
+
+			std::tuple<typename Arrays::value_type...> tmp(morton_impl::load(arrays,start)...);
+			size_t i = start;
+			for(;;) {
+				done[i] = true;
+				const size_t j = perm[i];
+				if(j==start)
+					break;
+				((arrays[i] = arrays[j]), ...);
+				i = j;
+			}
+			std::apply([&](const auto&... t) { ((arrays[i] = t), ...); },tmp);
+		}
+	}
+
+	/*
+	 * Sorts the positions and the companion arrays into Morton order of the
+	 * positions over their bounding box. Returns the permutation applied, so
+	 * that new index i holds the particle previously at perm[i].
+	 */
+	template<class Positions, class... Arrays>
+	std::vector<uint32_t> morton_reorder(unsigned threads, Positions& x, Arrays&... arrays) {
+		std::vector<uint64_t> keys;
+		morton_keys(x,bounding_box_of(x),keys,threads);
+		std::vector<uint32_t> perm = radix_sort_permutation(keys,threads);
+		apply_permutation(perm,x,arrays...);
+		return perm;
+	}
+
+}; // namespace dims
+
+#endif /* MORTON_HPP_ */
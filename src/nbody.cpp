@@ -0,0 +1,216 @@
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "vect.hpp"
+#include "dims.hpp"
+#include "parallel.hpp"
+#include "quantity_array.hpp"
+#include "reductions.hpp"
+
+/*
+ * Reference workload: a softened-gravity N-body simulation integrated with
+ * velocity-Verlet, written entirely in terms of quantity<...> types. The
+ * O(N^2) acceleration calculation is implemented for an array of particle
+ * structs (AoS) and for quantity_array storage (SoA), each run on one
+ * thread and on all threads, and the interaction rate is reported.
+ *
+ *     nbody [particles] [steps] [threads]
+ *
+ * All four variants integrate the same initial conditions so their final
+ * kinetic energies should agree (to rounding).
+ */
+
+using namespace std;
+using namespace dims;
+
+typedef nvect<3,double> real3;
+
+using gravitational_constant = IntDim<-1,3,-2>;
+
+struct parameters {
+	quantity<gravitational_constant> G;
+	area_t<> eps2;       // softening length squared
+	dims::time_t<> dt;
+};
+
+/*
+ * Array of structures
+ */
+
+struct particle {
+	quantity<position,real3> x;
+	velocity_t<real3> v;
+	acceleration_t<real3> a;
+	mass_t<> m;
+};
+
+void accelerations(vector<particle>& ps, const parameters& p, unsigned threads) {
+	const size_t n = ps.size();
+	parallel_for(n,threads,[&](size_t i) {
+		const quantity<position,real3> xi = ps[i].x;
+		acceleration_t<real3> a;
+		for(size_t j=0; j<n; ++j) {
+			const quantity<position,real3> d = ps[j].x - xi;
+			const area_t<> r2 = dot(d,d) + p.eps2;
+			a += p.G*ps[j].m/(r2*sqrt(r2))*d;
+		}
+		ps[i].a = a;
+	});
+}
+
+void step(vector<particle>& ps, const parameters& p, unsigned threads) {
+	const dims::time_t<> half_dt = p.dt/quantity<number>(2.0);
+	for(auto& q : ps) {
+		q.v += q.a*half_dt;
+		q.x += q.v*p.dt;
+	}
+	accelerations(ps,p,threads);
+	for(auto& q : ps)
+		q.v += q.a*half_dt;
+}
+
+work_t<> kinetic_energy(const vector<particle>& ps) {
+	return dims::reduce_quantities(ps.begin(),ps.end(),work_t<>(0.0),plus<work_t<>>(),
+		[](const particle& q) { return quantity<number>(0.5)*q.m*dot(q.v,q.v); });
+}
+
+/*
+ * Structure of arrays
+ */
+
+struct particles {
+	quantity_array<position,real3> x;
+	quantity_array<velocity,real3> v;
+	quantity_array<acceleration,real3> a;
+	quantity_array<mass> m;
+
+	explicit particles(const vector<particle>& ps) :x(ps.size()), v(ps.size()), a(ps.size()), m(ps.size()) {
+		for(size_t i=0; i<ps.size(); ++i) {
+			x[i] = ps[i].x;
+			v[i] = ps[i].v;
+			a[i] = ps[i].a;
+			m[i] = ps[i].m;
+		}
+	}
+
+	size_t size() const { return m.size(); }
+};
+
+void accelerations(particles& ps, const parameters& p, unsigned threads) {
+	const size_t n = ps.size();
+	const auto xs = ps.x.component(0), ys = ps.x.component(1), zs = ps.x.component(2);
+	const auto axs = ps.a.component(0), ays = ps.a.component(1), azs = ps.a.component(2);
+	const auto ms = ps.m.span();
+
+	parallel_for(n,threads,[&](size_t i) {
+		const length_t<> xi = xs[i], yi = ys[i], zi = zs[i];
+		acceleration_t<> ax(0.0), ay(0.0), az(0.0);
+		for(size_t j=0; j<n; ++j) {
+			const length_t<> dx = xs[j]-xi, dy = ys[j]-yi, dz = zs[j]-zi;
+			const area_t<> r2 = dx*dx + dy*dy + dz*dz + p.eps2;
+			const auto s = p.G*ms[j]/(r2*sqrt(r2));
+			ax += s*dx;
+			ay += s*dy;
+			az += s*dz;
+		}
+		axs[i] = ax;
+		ays[i] = ay;
+		azs[i] = az;
+	});
+}
+
+void step(particles& ps, const parameters& p, unsigned threads) {
+	const dims::time_t<> half_dt = p.dt/quantity<number>(2.0);
+	const size_t n = ps.size();
+	for(size_t c=0; c<3; ++c) {
+		const auto x = ps.x.component(c);
+		const auto v = ps.v.component(c);
+		const auto a = ps.a.component(c);
+		for(size_t i=0; i<n; ++i) {
+			v[i] += a[i]*half_dt;
+			x[i] += v[i]*p.dt;
+		}
+	}
+	accelerations(ps,p,threads);
+	for(size_t c=0; c<3; ++c) {
+		const auto v = ps.v.component(c);
+		const auto a = ps.a.component(c);
+		for(size_t i=0; i<n; ++i)
+			v[i] += a[i]*half_dt;
+	}
+}
+
+work_t<> kinetic_energy(particles& ps) {
+	const auto ms = ps.m.span();
+	const auto vs = ps.v.span();
+	work_t<> out(0.0);
+	for(size_t i=0; i<ps.size(); ++i)
+		out += quantity<number>(0.5)*ms[i]*dot(vs[i].get(),vs[i].get());
+	return out;
+}
+
+/*
+ * Driver
+ */
+
+vector<particle> initial_conditions(size_t n) {
+	// particles on a jittered cubic lattice with a small random velocity
+	vector<particle> ps(n);
+	const size_t side = size_t(cbrt(double(n)))+1;
+	unsigned seed = 12345;
+	auto rnd = [&seed] { seed = seed*1103515245u + 12345u; return double((seed>>8)&0xffff)/65536.0 - 0.5; };
+
+	for(size_t i=0; i<n; ++i) {
+		ps[i].x = quantity<position,real3>(double(i%side)+0.1*rnd(),double((i/side)%side)+0.1*rnd(),double(i/(side*side))+0.1*rnd());
+		ps[i].v = velocity_t<real3>(1e-3*rnd(),1e-3*rnd(),1e-3*rnd());
+		ps[i].a = acceleration_t<real3>(0.0,0.0,0.0);
+		ps[i].m = mass_t<>(1.0 + rnd());
+	}
+	return ps;
+}
+
+template<class Particles>
+void run(const string& name, Particles ps, const parameters& p, size_t steps, unsigned threads) {
+	accelerations(ps,p,threads);
+
+	auto start = chrono::steady_clock::now();
+	for(size_t s=0; s<steps; ++s)
+		step(ps,p,threads);
+	auto stop = chrono::steady_clock::now();
+
+	const double seconds = chrono::duration<double>(stop-start).count();
+	const double interactions = double(ps.size())*double(ps.size())*double(steps);
+
+	cout << left << setw(10) << name << right << setw(8) << threads
+		 << setw(14) << scientific << setprecision(3) << interactions/seconds
+		 << setw(16) << setprecision(9) << discard_dims(kinetic_energy(ps)) << endl;
+}
+
+int main(int argc, char* argv[])
+{
+	const size_t n = argc>1 ? strtoul(argv[1],nullptr,10) : 4096;
+	const size_t steps = argc>2 ? strtoul(argv[2],nullptr,10) : 10;
+	const unsigned threads = argc>3 ? (unsigned)strtoul(argv[3],nullptr,10) : default_threads();
+
+	parameters p;
+	p.G = quantity<gravitational_constant>(1e-3);
+	p.eps2 = area_t<>(1e-2);
+	p.dt = dims::time_t<>(1e-2);
+
+	const vector<particle> ps = initial_conditions(n);
+
+	cout << n << " particles, " << steps << " steps" << endl;
+	cout << left << setw(10) << "layout" << right << setw(8) << "threads"
+		 << setw(14) << "inter/s" << setw(16) << "kinetic" << endl;
+
+	run("aos",ps,p,steps,1);
+	run("aos",ps,p,steps,threads);
+	run("soa",particles(ps),p,steps,1);
+	run("soa",particles(ps),p,steps,threads);
+
+	return 0;
+}
@@ -0,0 +1,70 @@
+#ifndef PARALLEL_HPP_
+#define PARALLEL_HPP_
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+/*
+ * Minimal fork-join helpers used by the parallel algorithms in this
+ * library. Threads are started per call, so callers should only go parallel
+ * when there is enough work to amortise that (tens of microseconds). The
+ * functions passed in must not throw.
+ */
+
+namespace dims {
+
+	// the number of threads used when 0 is requested
+	inline unsigned default_threads() {
+		const unsigned n = std::thread::hardware_concurrency();
+		return n>0 ? n : 1;
+	}
+
+	/*
+	 * Run f(tid,nthreads) once on each of nthreads threads (the calling thread
+	 * is tid 0). Returns the number of threads actually used.
+	 */
+	template<class F>
+	unsigned parallel_run(unsigned threads, F f) {
+		if(threads==0)
+			threads = default_threads();
+
+		std::vector<std::thread> pool;
+		pool.reserve(threads-1);
+		for(unsigned t=1; t<threads; ++t)
+			pool.emplace_back([&f,t,threads]{ f(t,threads); });
+		f(0u,threads);
+
+		for(auto& th : pool)
+			th.join();
+		return threads;
+	}
+
+	/*
+	 * Call f(i) for every i in [0,count). Indices are handed out dynamically
+	 * so uneven work is balanced across the threads.
+	 */
+	template<class F>
+	void parallel_for(size_t count, unsigned threads, F f) {
+		if(threads==0)
+			threads = default_threads();
+		threads = (unsigned)std::min<size_t>(threads,count);
+
+		if(threads<=1) {
+			for(size_t i=0; i<count; ++i)
+				f(i);
+			return;
+		}
+
+		std::atomic<size_t> next(0);
+		parallel_run(threads,[&](unsigned,unsigned) {
+			for(size_t i=next++; i<count; i=next++)
+				f(i);
+		});
+	}
+
+}; // namespace dims
+
+#endif /* PARALLEL_HPP_ */
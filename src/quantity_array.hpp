@@ -0,0 +1,429 @@
+#ifndef QUANTITY_ARRAY_HPP_
+#define QUANTITY_ARRAY_HPP_
+
+#include "dims.hpp"
+#include "vect.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <numeric>
+#include <type_traits>
+
+namespace dims {
+
+	/*
+	 * Describes how a value type is split into scalar components for
+	 * structure-of-arrays storage. A scalar is a single component and an
+	 * nvect<N,T> is N components of type T.
+	 */
+	template<class T>
+	struct soa_traits {
+		using scalar_type = T;
+		static constexpr size_t components = 1;
+
+		static scalar_type get(const T& v, size_t) { return v; }
+		static void set(T& v, size_t, const scalar_type& s) { v = s; }
+	};
+
+	template<size_t N, class T>
+	struct soa_traits<nvect<N,T>> {
+		using scalar_type = T;
+		static constexpr size_t components = N;
+
+		static scalar_type get(const nvect<N,T>& v, size_t c) { return v[c]; }
+		static void set(nvect<N,T>& v, size_t c, const scalar_type& s) { v[c] = s; }
+	};
+
+	template<class Dim, class T> class quantity_ref;
+	template<class Dim, class T> class quantity_span;
+
+	template<class T>
+	struct is_quantity_ref : std::false_type {};
+
+	template<class Dim, class T>
+	struct is_quantity_ref<quantity_ref<Dim,T>> : std::true_type {};
+
+	/*
+	 * Proxy for a single element of a structure-of-arrays container. It holds
+	 * one pointer per component and reads/writes the quantity<Dim,T> element
+	 * through them. Assignment writes through to the storage rather than
+	 * rebinding the proxy.
+	 */
+	template<class Dim, class T>
+	class quantity_ref {
+		using traits = soa_traits<T>;
+		using scalar_type = typename traits::scalar_type;
+		static constexpr size_t N = traits::components;
+
+		std::array<scalar_type*,N> ptrs;
+
+	public:
+		using value_type = quantity<Dim,T>;
+
+		explicit quantity_ref(const std::array<scalar_type*,N>& ptrs) :ptrs(ptrs) {}
+
+		value_type get() const {
+			T out;
+			for(size_t c=0; c<N; ++c)
+				traits::set(out,c,*ptrs[c]);
+			return value_type(out);
+		}
+
+		operator value_type() const {
+			return get();
+		}
+
+		// assignment writes the value, dimensions must match
+		template<class Dim2>
+		quantity_ref& operator=(const quantity<Dim2,T>& rhs) {
+			static_assert(std::is_same<Dim,Dim2>::value,"Cannot assign quantities with different dimensions.");
+			const T v = discard_dims(rhs);
+			for(size_t c=0; c<N; ++c)
+				*ptrs[c] = traits::get(v,c);
+			return *this;
+		}
+
+		quantity_ref& operator=(const quantity_ref& rhs) {
+			return *this = rhs.get();
+		}
+
+		template<class Dim2, class T2>
+		quantity_ref& operator=(const quantity_ref<Dim2,T2>& rhs) {
+			return *this = rhs.get();
+		}
+
+		template<class Dim2, class T2>
+		quantity_ref& operator+=(const quantity<Dim2,T2>& rhs) {
+			value_type v = get();
+			v += rhs;
+			return *this = v;
+		}
+
+		template<class Dim2, class T2>
+		quantity_ref& operator-=(const quantity<Dim2,T2>& rhs) {
+			value_type v = get();
+			v -= rhs;
+			return *this = v;
+		}
+
+		template<class Dim2, class T2>
+		quantity_ref& operator*=(const quantity<Dim2,T2>& rhs) {
+			value_type v = get();
+			v *= rhs;
+			return *this = v;
+		}
+
+		template<class Dim2, class T2>
+		quantity_ref& operator/=(const quantity<Dim2,T2>& rhs) {
+			value_type v = get();
+			v /= rhs;
+			return *this = v;
+		}
+
+		template<class Dim2, class T2>
+		quantity_ref& operator+=(const quantity_ref<Dim2,T2>& rhs) { return *this += rhs.get(); }
+
+		template<class Dim2, class T2>
+		quantity_ref& operator-=(const quantity_ref<Dim2,T2>& rhs) { return *this -= rhs.get(); }
+
+		// swaps the referenced values (so std::sort etc. work through span iterators)
+		friend void swap(quantity_ref a, quantity_ref b) {
+			const value_type tmp = a.get();
+			a = b.get();
+			b = tmp;
+		}
+
+		friend std::ostream& operator<<(std::ostream& out, const quantity_ref& ref) {
+			return out << ref.get();
+		}
+	};
+
+	/*
+	 * Arithmetic on proxies loads the value and then uses the normal quantity
+	 * operators, so dimension checking is unchanged.
+	 */
+	template<class T>
+	const T& value_of(const T& t) { return t; }
+
+	template<class Dim, class T>
+	quantity<Dim,T> value_of(const quantity_ref<Dim,T>& ref) { return ref.get(); }
+
+#define QREF_OP_IMPL(op) \
+	template<class L, class R, class = typename std::enable_if<is_quantity_ref<L>::value || is_quantity_ref<R>::value>::type> \
+	auto operator op (const L& l, const R& r) -> decltype(value_of(l) op value_of(r)) { \
+		return value_of(l) op value_of(r); \
+	}
+
+	QREF_OP_IMPL(+)
+	QREF_OP_IMPL(-)
+	QREF_OP_IMPL(*)
+	QREF_OP_IMPL(/)
+	QREF_OP_IMPL(<)
+	QREF_OP_IMPL(<=)
+	QREF_OP_IMPL(>)
+	QREF_OP_IMPL(>=)
+
+#undef QREF_OP_IMPL
+
+	/*
+	 * Non-owning view of a structure-of-arrays range of quantity<Dim,T>. The
+	 * elements are stored as one contiguous array of scalars per component.
+	 */
+	template<class Dim, class T>
+	class quantity_span {
+		using traits = soa_traits<T>;
+
+	public:
+		using scalar_type = typename traits::scalar_type;
+		static constexpr size_t components = traits::components;
+
+		using value_type = quantity<Dim,T>;
+		using reference = quantity_ref<Dim,T>;
+		using pointers = std::array<scalar_type*,components>;
+
+		quantity_span() :ptrs(), n(0) {}
+		quantity_span(const pointers& ptrs, size_t n) :ptrs(ptrs), n(n) {}
+
+		size_t size() const { return n; }
+		bool empty() const { return n==0; }
+
+		reference operator[](size_t i) const {
+			pointers p;
+			for(size_t c=0; c<components; ++c)
+				p[c] = ptrs[c]+i;
+			return reference(p);
+		}
+
+		// a view of one component, e.g. the x-coordinates of a set of positions
+		quantity_span<Dim,scalar_type> component(size_t c) const {
+			return quantity_span<Dim,scalar_type>({{ptrs[c]}},n);
+		}
+
+		quantity_span subspan(size_t offset, size_t count) const {
+			pointers p;
+			for(size_t c=0; c<components; ++c)
+				p[c] = ptrs[c]+offset;
+			return quantity_span(p,count);
+		}
+
+		// discard dimensional safety and get the raw component array
+		scalar_type* data(size_t c=0) const {
+			return ptrs[c];
+		}
+
+		// random access iterator yielding proxies, independent of the span it came from
+		class iterator {
+			pointers ptrs;
+			size_t i;
+
+		public:
+			using iterator_category = std::random_access_iterator_tag;
+			using value_type = quantity<Dim,T>;
+			using difference_type = std::ptrdiff_t;
+			using reference = quantity_ref<Dim,T>;
+			using pointer = void;
+
+			iterator() :ptrs(), i(0) {}
+			iterator(const pointers& ptrs, size_t i) :ptrs(ptrs), i(i) {}
+
+			reference operator*() const { return quantity_span(ptrs,i+1)[i]; }
+			reference operator[](difference_type d) const { return quantity_span(ptrs,i+d+1)[i+d]; }
+
+			iterator& operator++() { ++i; return *this; }
+			iterator& operator--() { --i; return *this; }
+			iterator operator++(int) { iterator out = *this; ++i; return out; }
+			iterator operator--(int) { iterator out = *this; --i; return out; }
+			iterator& operator+=(difference_type d) { i += d; return *this; }
+			iterator& operator-=(difference_type d) { i -= d; return *this; }
+			iterator operator+(difference_type d) const { return iterator(ptrs,i+d); }
+			iterator operator-(difference_type d) const { return iterator(ptrs,i-d); }
+			difference_type operator-(const iterator& it) const { return difference_type(i)-difference_type(it.i); }
+
+			bool operator==(const iterator& it) const { return i==it.i; }
+			bool operator!=(const iterator& it) const { return i!=it.i; }
+			bool operator< (const iterator& it) const { return i< it.i; }
+			bool operator<=(const iterator& it) const { return i<=it.i; }
+			bool operator> (const iterator& it) const { return i> it.i; }
+			bool operator>=(const iterator& it) const { return i>=it.i; }
+		};
+
+		iterator begin() const { return iterator(ptrs,0); }
+		iterator end() const { return iterator(ptrs,n); }
+
+	private:
+		pointers ptrs;
+		size_t n;
+	};
+
+	/*
+	 * A container of quantity<Dim,T> which stores the scalar components of T as
+	 * structure-of-arrays. Each component array starts on an Align byte boundary
+	 * and is padded to a multiple of Align, so loops over the raw component
+	 * arrays auto-vectorize. Elements are accessed through quantity_ref proxies
+	 * and the dimensions are still checked at compile time.
+	 */
+	template<class Dim, class T=double, size_t Align=64>
+	class quantity_array {
+		using traits = soa_traits<T>;
+		using this_type = quantity_array<Dim,T,Align>;
+
+	public:
+		using scalar_type = typename traits::scalar_type;
+		static constexpr size_t components = traits::components;
+		static constexpr size_t alignment = Align;
+
+		using value_type = quantity<Dim,T>;
+		using reference = quantity_ref<Dim,T>;
+		using span_type = quantity_span<Dim,T>;
+
+		static_assert((Align & (Align-1))==0,"Alignment must be a power of two");
+		static_assert(Align>=alignof(scalar_type),"Alignment must be at least that of the scalar type");
+		static_assert(std::is_trivially_copyable<scalar_type>::value,"quantity_array requires a trivially copyable scalar type");
+
+		quantity_array() :n(0), stride(0) {}
+
+		explicit quantity_array(size_t n) :n(0), stride(0) {
+			resize(n);
+		}
+
+		quantity_array(size_t n, const value_type& fill) :quantity_array(n) {
+			for(size_t i=0; i<n; ++i)
+				(*this)[i] = fill;
+		}
+
+		quantity_array(const this_type& rhs) :n(0), stride(0) {
+			reserve(rhs.n);
+			n = rhs.n;
+			for(size_t c=0; c<components; ++c)
+				std::copy(rhs.data(c),rhs.data(c)+n,data(c));
+		}
+
+		quantity_array(this_type&& rhs) noexcept
+		:storage(std::move(rhs.storage)), n(rhs.n), stride(rhs.stride) {
+			rhs.n = rhs.stride = 0;
+		}
+
+		this_type& operator=(const this_type& rhs) {
+			if(this != &rhs) {
+				this_type tmp(rhs);
+				*this = std::move(tmp);
+			}
+			return *this;
+		}
+
+		this_type& operator=(this_type&& rhs) noexcept {
+			storage = std::move(rhs.storage);
+			n = rhs.n;
+			stride = rhs.stride;
+			rhs.n = rhs.stride = 0;
+			return *this;
+		}
+
+		size_t size() const { return n; }
+		bool empty() const { return n==0; }
+		size_t capacity() const { return stride; }
+
+		// grow the storage without changing the size, existing elements are kept
+		void reserve(size_t count) {
+			if(count <= stride)
+				return;
+
+			const size_t new_stride = round_up(count);
+			aligned_ptr new_storage = allocate(new_stride*components);
+			for(size_t c=0; c<components; ++c)
+				std::copy(data(c),data(c)+n,new_storage.get()+c*new_stride);
+
+			storage = std::move(new_storage);
+			stride = new_stride;
+		}
+
+		// new elements are value-initialised (i.e. zero for arithmetic types)
+		void resize(size_t count) {
+			reserve(count);
+			for(size_t c=0; c<components; ++c)
+				std::fill(data(c)+std::min(n,count),data(c)+count,scalar_type());
+			n = count;
+		}
+
+		void push_back(const value_type& v) {
+			if(n == stride)
+				reserve(std::max<size_t>(2*stride,1));
+			++n;
+			(*this)[n-1] = v;
+		}
+
+		void clear() { n = 0; }
+
+		reference operator[](size_t i) {
+			return span()[i];
+		}
+
+		value_type operator[](size_t i) const {
+			T out;
+			for(size_t c=0; c<components; ++c)
+				traits::set(out,c,data(c)[i]);
+			return value_type(out);
+		}
+
+		span_type span() {
+			typename span_type::pointers p;
+			for(size_t c=0; c<components; ++c)
+				p[c] = data(c);
+			return span_type(p,n);
+		}
+
+		// a view of one component, e.g. the x-coordinates of a set of positions
+		quantity_span<Dim,scalar_type> component(size_t c) {
+			return quantity_span<Dim,scalar_type>({{data(c)}},n);
+		}
+
+		// discard dimensional safety and get the raw (aligned) component array
+		scalar_type* data(size_t c=0) {
+			return assume_aligned(storage.get()+c*stride);
+		}
+
+		const scalar_type* data(size_t c=0) const {
+			return assume_aligned(storage.get()+c*stride);
+		}
+
+	private:
+		struct aligned_delete {
+			void operator()(scalar_type* p) const {
+				::operator delete(p,std::align_val_t(Align));
+			}
+		};
+
+		using aligned_ptr = std::unique_ptr<scalar_type[],aligned_delete>;
+
+		static aligned_ptr allocate(size_t count) {
+			return aligned_ptr(static_cast<scalar_type*>(::operator new(count*sizeof(scalar_type),std::align_val_t(Align))));
+		}
+
+		// number of elements rounded up so each component array is a multiple of Align bytes
+		// (a multiple of lcm(Align,sizeof(scalar_type)) bytes, also when the size does not divide Align)
+		static size_t round_up(size_t count) {
+			constexpr size_t per_line = Align/std::gcd(Align,sizeof(scalar_type));
+			return ((count+per_line-1)/per_line)*per_line;
+		}
+
+		template<class P>
+		static P* assume_aligned(P* p) {
+#if defined(__GNUC__)
+			return static_cast<P*>(__builtin_assume_aligned(p,Align));
+#else
+			return p;
+#endif
+		}
+
+		aligned_ptr storage;
+		size_t n;
+		size_t stride;
+	};
+
+}; // namespace dims
+
+#endif /* QUANTITY_ARRAY_HPP_ */
@@ -0,0 +1,228 @@
+#ifndef QUANTITY_EXPR_HPP_
+#define QUANTITY_EXPR_HPP_
+
+#include "dims.hpp"
+#include "vect.hpp"
+
+#include <type_traits>
+
+/*
+ * Lazy (expression template) arithmetic for vector valued quantities.
+ *
+ * Wrapping an operand with lazy() makes the arithmetic operators build an
+ * expression tree instead of a new value. The dimensions are computed at
+ * compile time exactly as for quantity, and the whole expression is
+ * evaluated element by element in a single loop when it is assigned to a
+ * quantity, e.g.
+ *
+ *     quantity<position,real3> x2 = lazy(x) + lazy(v)*dt + 0.5*lazy(a)*dt*dt;
+ *
+ * Leaves hold references to their operands, so an expression must be
+ * assigned before the quantities it refers to go out of scope.
+ */
+
+namespace dims {
+
+	namespace expr {
+
+		// the length of a vector value type (declared in dims.hpp)
+		template<class V>
+		struct vect_size : std::integral_constant<size_t,0> {};
+
+		template<size_t N, class T>
+		struct vect_size<nvect<N,T>> : std::integral_constant<size_t,N> {};
+
+		/*
+		 * Expression nodes. Each node has a static 'size' (0 for values which are
+		 * broadcast to every element) and an operator[] giving the raw value of
+		 * element i.
+		 */
+
+		template<size_t N, class T>
+		struct vect_leaf {
+			static constexpr size_t size = N;
+			const nvect<N,T>& v;
+
+			const T& operator[](size_t i) const {
+				return v[i];
+			}
+		};
+
+		template<class S>
+		struct scalar_leaf {
+			static constexpr size_t size = 0;
+			S s;
+
+			const S& operator[](size_t) const {
+				return s;
+			}
+		};
+
+		struct add { template<class A, class B> static auto apply(const A& a, const B& b) { return a+b; } };
+		struct sub { template<class A, class B> static auto apply(const A& a, const B& b) { return a-b; } };
+		struct mul { template<class A, class B> static auto apply(const A& a, const B& b) { return a*b; } };
+		struct div { template<class A, class B> static auto apply(const A& a, const B& b) { return a/b; } };
+
+		template<class Op, class L, class R>
+		struct binary {
+			static_assert(L::size==R::size || L::size==0 || R::size==0,"Cannot combine vectors of different lengths");
+			static constexpr size_t size = L::size>R::size ? L::size : R::size;
+			L l;
+			R r;
+
+			auto operator[](size_t i) const {
+				return Op::apply(l[i],r[i]);
+			}
+		};
+
+		template<class E>
+		struct negate {
+			static constexpr size_t size = E::size;
+			E e;
+
+			auto operator[](size_t i) const {
+				return -e[i];
+			}
+		};
+
+	}; // namespace expr
+
+	/*
+	 * A lazily evaluated quantity with dimensions Dim.
+	 */
+	template<class Dim, class E>
+	struct quantity_expr {
+
+		static_assert(E::size>0,"A quantity expression must contain at least one vector operand");
+
+		using node_type = E;
+		using value_type = typename std::decay<decltype(std::declval<E>()[0])>::type;
+		static constexpr size_t size = E::size;
+
+		E e;
+
+		// evaluate the expression into out (or add/subtract it from out) in one pass
+		template<class V>
+		void eval_to(V& out) const {
+			for(size_t i=0; i<size; ++i)
+				out[i] = e[i];
+		}
+
+		template<class V>
+		void add_to(V& out) const {
+			for(size_t i=0; i<size; ++i)
+				out[i] += e[i];
+		}
+
+		template<class V>
+		void sub_to(V& out) const {
+			for(size_t i=0; i<size; ++i)
+				out[i] -= e[i];
+		}
+	};
+
+	template<class T>
+	struct is_quantity_expr : std::false_type {};
+
+	template<class Dim, class E>
+	struct is_quantity_expr<quantity_expr<Dim,E>> : std::true_type {};
+
+	// evaluate an expression into a new quantity
+	template<class Dim, class E>
+	quantity<Dim,nvect<E::size,typename quantity_expr<Dim,E>::value_type>> eval(const quantity_expr<Dim,E>& e) {
+		return e;
+	}
+
+	/*
+	 * Start a lazy expression. Vector quantities become expression leaves,
+	 * for scalars there is nothing to fuse so the quantity itself is returned
+	 * and the normal (eager) operators are used.
+	 */
+	template<class Dim, size_t N, class T>
+	quantity_expr<Dim,expr::vect_leaf<N,T>> lazy(const quantity<Dim,nvect<N,T>>& q) {
+		return {{q.val}};
+	}
+
+	template<class Dim, class T>
+	const quantity<Dim,T>& lazy(const quantity<Dim,T>& q) {
+		return q;
+	}
+
+	/*
+	 * Converts an operand to its dimensions and expression node. Plain
+	 * arithmetic values are treated as dimensionless.
+	 */
+	template<class T, class Enable=void>
+	struct as_operand;
+
+	template<class Dim, class E>
+	struct as_operand<quantity_expr<Dim,E>> {
+		using dim = Dim;
+		using node = E;
+		static const E& get(const quantity_expr<Dim,E>& q) { return q.e; }
+	};
+
+	template<class Dim, size_t N, class T>
+	struct as_operand<quantity<Dim,nvect<N,T>>> {
+		using dim = Dim;
+		using node = expr::vect_leaf<N,T>;
+		static node get(const quantity<Dim,nvect<N,T>>& q) { return {q.val}; }
+	};
+
+	template<class Dim, class T>
+	struct as_operand<quantity<Dim,T>> {
+		using dim = Dim;
+		using node = expr::scalar_leaf<T>;
+		static node get(const quantity<Dim,T>& q) { return {q.val}; }
+	};
+
+	template<class T>
+	struct as_operand<T,typename std::enable_if<std::is_arithmetic<T>::value>::type> {
+		using dim = number;
+		using node = expr::scalar_leaf<T>;
+		static node get(const T& t) { return {t}; }
+	};
+
+	template<class Op, class Dim, class L, class R>
+	using binary_expr = quantity_expr<Dim,expr::binary<Op,typename as_operand<L>::node,typename as_operand<R>::node>>;
+
+	template<class L, class R>
+	using enable_if_expr = typename std::enable_if<is_quantity_expr<L>::value || is_quantity_expr<R>::value>::type;
+
+	/*
+	 * Operators which build the expression tree. At least one operand must
+	 * already be an expression, so the eager quantity operators are untouched.
+	 */
+
+	template<class L, class R, class = enable_if_expr<L,R>>
+	binary_expr<expr::add,typename as_operand<L>::dim,L,R> operator+(const L& l, const R& r) {
+		static_assert(std::is_same<typename as_operand<L>::dim,typename as_operand<R>::dim>::value,"Cannot add quantities with different dimensions.");
+		return {{as_operand<L>::get(l),as_operand<R>::get(r)}};
+	}
+
+	template<class L, class R, class = enable_if_expr<L,R>>
+	binary_expr<expr::sub,typename as_operand<L>::dim,L,R> operator-(const L& l, const R& r) {
+		static_assert(std::is_same<typename as_operand<L>::dim,typename as_operand<R>::dim>::value,"Cannot subtract quantities with different dimensions.");
+		return {{as_operand<L>::get(l),as_operand<R>::get(r)}};
+	}
+
+	template<class L, class R, class = enable_if_expr<L,R>>
+	binary_expr<expr::mul,typename mult_Dimension<typename as_operand<L>::dim,typename as_operand<R>::dim>::result,L,R>
+	operator*(const L& l, const R& r) {
+		return {{as_operand<L>::get(l),as_operand<R>::get(r)}};
+	}
+
+	template<class L, class R, class = enable_if_expr<L,R>>
+	binary_expr<expr::div,typename mult_Dimension<typename as_operand<L>::dim,typename inv_Dimension<typename as_operand<R>::dim>::result>::result,L,R>
+	operator/(const L& l, const R& r) {
+		return {{as_operand<L>::get(l),as_operand<R>::get(r)}};
+	}
+
+	template<class Dim, class E>
+	quantity_expr<Dim,expr::negate<E>> operator-(const quantity_expr<Dim,E>& q) {
+		return {{q.e}};
+	}
+
+}; // namespace dims
+
+#endif /* QUANTITY_EXPR_HPP_ */
@@ -0,0 +1,427 @@
+#ifndef QUANTITY_FIELD_HPP_
+#define QUANTITY_FIELD_HPP_
+
+#include "dims.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <new>
+#include <type_traits>
+
+/*
+ * Fields of quantities on D dimensional structured grids, e.g. the pressure
+ * or velocity of a finite volume solver.
+ *
+ *     quantity_field<pressure> p({nx,ny,nz},1);        // one ghost layer
+ *     p(i,j,k) = p(i-1,j,k) + dp;                      // quantity<pressure>&
+ *     auto blk = p.view({0,0,0},{16,16,16});           // sub-block, no copy
+ *
+ * Elements are stored as quantity<Dim,T> directly, so access returns a plain
+ * reference with no proxy. Indices run from -ghost to extent+ghost-1 in each
+ * direction, the last index is the fastest varying. The memory order is set
+ * by the Layout:
+ *
+ *  - row_major pads each row so that element 0 of every row starts on an
+ *    Align byte boundary, so loops along rows vectorize.
+ *  - tiled<B...> stores B[0] x ... x B[D-1] blocks contiguously (each B a
+ *    power of two) so that neighbours in every direction share cache lines.
+ */
+
+namespace dims {
+
+	template<size_t D>
+	using field_index = std::array<ptrdiff_t,D>;
+
+	namespace field_impl {
+
+		constexpr size_t round_up(size_t n, size_t m) {
+			return (n+m-1)/m*m;
+		}
+
+		constexpr size_t log2(size_t n) {
+			return n<=1 ? 0 : 1+log2(n/2);
+		}
+
+		template<size_t... Bs>
+		constexpr bool all_powers_of_two() {
+			return ((Bs>0 && (Bs&(Bs-1))==0) && ...);
+		}
+
+	} // namespace field_impl
+
+	/*
+	 * Layouts. Each provides a mapping<D,T,Align> from grid indices to
+	 * storage offsets, cheap steps to neighbouring cells, and the blocks it is
+	 * best traversed by.
+	 */
+
+	struct row_major {
+
+		template<size_t D, class T, size_t Align>
+		class mapping {
+			static constexpr size_t lanes = Align>=sizeof(T) ? Align/sizeof(T) : 1;
+
+		public:
+			mapping() :origin(0), total(0), strides() {}
+
+			mapping(const std::array<size_t,D>& n, size_t ghost) {
+				// the leading ghost cells of a row are padded so that index 0 is aligned
+				const size_t lead = field_impl::round_up(ghost,lanes);
+				size_t stride = field_impl::round_up(lead+n[D-1]+ghost,lanes);
+				strides[D-1] = 1;
+				origin = lead;
+				for(size_t d=D-1; d-->0;) {
+					strides[d] = stride;
+					origin += ghost*stride;
+					stride *= n[d]+2*ghost;
+				}
+				total = stride;
+			}
+
+			size_t offset(const field_index<D>& i) const {
+				size_t out = origin;
+				for(size_t d=0; d<D; ++d)
+					out += i[d]*ptrdiff_t(strides[d]);
+				return out;
+			}
+
+			// the offset of i moved by s cells along d, given o = offset(i)
+			size_t neighbour(size_t o, const field_index<D>&, size_t d, ptrdiff_t s) const {
+				return o + s*ptrdiff_t(strides[d]);
+			}
+
+			size_t size() const { return total; }
+
+			// distance in elements between neighbours along direction d
+			ptrdiff_t stride(size_t d) const { return strides[d]; }
+
+			// end of the traversal block containing i along d, blocks are whole rows
+			ptrdiff_t block_end(size_t d, ptrdiff_t i) const {
+				return d==D-1 ? std::numeric_limits<ptrdiff_t>::max() : i+1;
+			}
+
+		private:
+			size_t origin;
+			size_t total;
+			std::array<size_t,D> strides;
+		};
+	};
+
+	template<size_t... Bs>
+	struct tiled {
+
+		static_assert(field_impl::all_powers_of_two<Bs...>(),"Tile extents must be powers of two");
+
+		template<size_t D, class T, size_t Align>
+		class mapping {
+			static_assert(sizeof...(Bs)==D,"Need one tile extent per grid dimension");
+
+			static constexpr std::array<size_t,D> extents = {{Bs...}};
+			static constexpr std::array<size_t,D> shifts = {{field_impl::log2(Bs)...}};
+			static constexpr size_t volume = (Bs * ...);
+
+		public:
+			mapping() :ghost(0), total(0), tile_strides(), in_strides() {}
+
+			mapping(const std::array<size_t,D>& n, size_t ghost) :ghost(ghost) {
+				size_t tiles = 1, in = 1;
+				for(size_t d=D; d-->0;) {
+					tile_strides[d] = tiles*volume;
+					in_strides[d] = in;
+					tiles *= (n[d]+2*ghost+extents[d]-1) >> shifts[d];
+					in *= extents[d];
+				}
+				total = tiles*volume;
+			}
+
+			size_t offset(const field_index<D>& i) const {
+				size_t out = 0;
+				for(size_t d=0; d<D; ++d)
+					out += tile_part(size_t(i[d]+ptrdiff_t(ghost)),d);
+				return out;
+			}
+
+			// the offset of i moved by s cells along d, given o = offset(i)
+			size_t neighbour(size_t o, const field_index<D>& i, size_t d, ptrdiff_t s) const {
+				const size_t j = size_t(i[d]+ptrdiff_t(ghost));
+				return o - tile_part(j,d) + tile_part(j+s,d);
+			}
+
+			size_t size() const { return total; }
+
+			// end of the traversal block containing i along d, blocks are tiles
+			ptrdiff_t block_end(size_t d, ptrdiff_t i) const {
+				return ptrdiff_t((((i+ghost) >> shifts[d])+1) << shifts[d]) - ptrdiff_t(ghost);
+			}
+
+		private:
+			size_t tile_part(size_t j, size_t d) const {
+				return (j >> shifts[d])*tile_strides[d] + (j & (extents[d]-1))*in_strides[d];
+			}
+
+			size_t ghost;
+			size_t total;
+			std::array<size_t,D> tile_strides;
+			std::array<size_t,D> in_strides;
+		};
+	};
+
+	template<class Dim, class T, size_t D, class Layout, size_t Align> class quantity_field_view;
+
+	/*
+	 * Owning D dimensional grid of quantity<Dim,T>. The storage (including
+	 * ghost cells and padding) is one Align byte aligned allocation.
+	 */
+	template<class Dim, class T=double, size_t D=3, class Layout=row_major, size_t Align=64>
+	class quantity_field {
+		using this_type = quantity_field<Dim,T,D,Layout,Align>;
+
+	public:
+		using dimension = Dim;
+		using data_type = T;
+		using value_type = quantity<Dim,T>;
+		using mapping_type = typename Layout::template mapping<D,T,Align>;
+		using index_type = field_index<D>;
+		using view_type = quantity_field_view<Dim,T,D,Layout,Align>;
+		using const_view_type = quantity_field_view<Dim,const T,D,Layout,Align>;
+		static constexpr size_t dimensions = D;
+
+		static_assert(D>0,"Cannot create a field with no dimensions");
+		static_assert((Align & (Align-1))==0,"Alignment must be a power of two");
+		static_assert(Align>=alignof(value_type),"Alignment must be at least that of the value type");
+		static_assert(std::is_trivially_copyable<T>::value,"quantity_field requires a trivially copyable value type");
+		static_assert(sizeof(value_type)==sizeof(T),"quantity must have the same layout as its value");
+
+		quantity_field() :n(), ghost_cells(0) {}
+
+		// all elements, including ghosts, are value-initialised (zero)
+		quantity_field(const std::array<size_t,D>& n, size_t ghost=0)
+		:n(n), ghost_cells(ghost), map(n,ghost), storage(allocate(map.size())) {
+			std::uninitialized_fill_n(storage.get(),map.size(),value_type());
+		}
+
+		quantity_field(const std::array<size_t,D>& n, size_t ghost, const value_type& fill) :quantity_field(n,ghost) {
+			this->fill(fill);
+		}
+
+		quantity_field(const this_type& rhs)
+		:n(rhs.n), ghost_cells(rhs.ghost_cells), map(rhs.map), storage(allocate(map.size())) {
+			std::uninitialized_copy_n(rhs.storage.get(),map.size(),storage.get());
+		}
+
+		quantity_field(this_type&&) noexcept = default;
+
+		this_type& operator=(const this_type& rhs) {
+			if(this != &rhs) {
+				this_type tmp(rhs);
+				*this = std::move(tmp);
+			}
+			return *this;
+		}
+
+		this_type& operator=(this_type&&) noexcept = default;
+
+		/*
+		 * Element access, each index may range over [-ghost, extent+ghost)
+		 */
+
+		template<class... Is>
+		value_type& operator()(Is... is) {
+			static_assert(sizeof...(Is)==D,"Wrong number of indices");
+			return data()[map.offset(index_type{{ptrdiff_t(is)...}})];
+		}
+
+		template<class... Is>
+		const value_type& operator()(Is... is) const {
+			static_assert(sizeof...(Is)==D,"Wrong number of indices");
+			return data()[map.offset(index_type{{ptrdiff_t(is)...}})];
+		}
+
+		value_type& operator[](const index_type& i) {
+			return data()[map.offset(i)];
+		}
+
+		const value_type& operator[](const index_type& i) const {
+			return data()[map.offset(i)];
+		}
+
+		const std::array<size_t,D>& extents() const { return n; }
+		size_t extent(size_t d) const { return n[d]; }
+		size_t ghost() const { return ghost_cells; }
+
+		// number of interior cells
+		size_t size() const {
+			size_t out = 1;
+			for(size_t d=0; d<D; ++d)
+				out *= n[d];
+			return out;
+		}
+
+		const mapping_type& mapping() const { return map; }
+
+		// sets the interior and ghost cells
+		void fill(const value_type& v) {
+			std::fill_n(data(),map.size(),v);
+		}
+
+		// a view of the sub-block [origin, origin+count), which may include ghosts
+		view_type view(const index_type& origin, const std::array<size_t,D>& count) {
+			return view_type(data(),map,origin,count);
+		}
+
+		const_view_type view(const index_type& origin, const std::array<size_t,D>& count) const {
+			return const_view_type(data(),map,origin,count);
+		}
+
+		// the interior as a view
+		view_type interior() {
+			return view(index_type(),n);
+		}
+
+		/*
+		 * Calls f(lo,hi) for blocks covering the interior in storage order
+		 * (rows or tiles), hi is one past the end in each direction.
+		 */
+		template<class F>
+		void for_each_block(F&& f) const {
+			if(size()==0)
+				return;
+			index_type lo = index_type(), hi;
+			for(;;) {
+				for(size_t d=0; d<D; ++d)
+					hi[d] = std::min<ptrdiff_t>(n[d],map.block_end(d,lo[d]));
+				f(static_cast<const index_type&>(lo),static_cast<const index_type&>(hi));
+				// advance like an odometer, the faster directions restart at 0
+				size_t d = D;
+				while(d-->0) {
+					lo[d] = hi[d];
+					if(lo[d] < ptrdiff_t(n[d]))
+						break;
+					lo[d] = 0;
+				}
+				if(d==size_t(-1))
+					return;
+			}
+		}
+
+		// calls f(q,i) for every interior cell, traversing block by block
+		template<class F>
+		void for_each(F&& f) {
+			for_each_block([&](const index_type& lo, const index_type& hi) {
+				index_type i = lo;
+				for(;;) {
+					f((*this)[i],static_cast<const index_type&>(i));
+					size_t d = D;
+					while(d-->0) {
+						if(++i[d] < hi[d])
+							break;
+						i[d] = lo[d];
+					}
+					if(d==size_t(-1))
+						return;
+				}
+			});
+		}
+
+		// discard dimensional safety and get the raw storage (including padding)
+		T* raw() { return reinterpret_cast<T*>(data()); }
+		const T* raw() const { return reinterpret_cast<const T*>(data()); }
+		size_t storage_size() const { return map.size(); }
+
+		value_type* data() {
+			return assume_aligned(storage.get());
+		}
+
+		const value_type* data() const {
+			return assume_aligned(storage.get());
+		}
+
+	private:
+		struct aligned_delete {
+			void operator()(value_type* p) const {
+				::operator delete(p,std::align_val_t(Align));
+			}
+		};
+
+		using aligned_ptr = std::unique_ptr<value_type[],aligned_delete>;
+
+		static aligned_ptr allocate(size_t count) {
+			return aligned_ptr(static_cast<value_type*>(::operator new(std::max<size_t>(count,1)*sizeof(value_type),std::align_val_t(Align))));
+		}
+
+		template<class P>
+		static P* assume_aligned(P* p) {
+#if defined(__GNUC__)
+			return static_cast<P*>(__builtin_assume_aligned(p,Align));
+#else
+			return p;
+#endif
+		}
+
+		std::array<size_t,D> n;
+		size_t ghost_cells;
+		mapping_type map;
+		aligned_ptr storage;
+	};
+
+	/*
+	 * Non-owning view of a rectangular sub-block of a quantity_field. Indices
+	 * are relative to the block origin. Views hold the data pointer, a copy of
+	 * the field's index mapping and two index arrays, so they are cheap to copy
+	 * and pass to kernels, and stay valid when the field is moved.
+	 */
+	template<class Dim, class T, size_t D, class Layout, size_t Align>
+	class quantity_field_view {
+		using plain_type = typename std::remove_const<T>::type;
+		using element_type = typename std::conditional<std::is_const<T>::value,const quantity<Dim,plain_type>,quantity<Dim,plain_type>>::type;
+		using mapping_type = typename Layout::template mapping<D,plain_type,Align>;
+
+	public:
+		using value_type = quantity<Dim,plain_type>;
+		using index_type = field_index<D>;
+
+		quantity_field_view(element_type* base, const mapping_type& map, const index_type& origin, const std::array<size_t,D>& n)
+		:base(base), map(map), origin(origin), n(n) {}
+
+		template<class... Is>
+		element_type& operator()(Is... is) const {
+			static_assert(sizeof...(Is)==D,"Wrong number of indices");
+			return (*this)[index_type{{ptrdiff_t(is)...}}];
+		}
+
+		element_type& operator[](const index_type& i) const {
+			index_type j;
+			for(size_t d=0; d<D; ++d)
+				j[d] = i[d]+origin[d];
+			return base[map.offset(j)];
+		}
+
+		const std::array<size_t,D>& extents() const { return n; }
+		size_t extent(size_t d) const { return n[d]; }
+		const index_type& offset() const { return origin; }
+
+		// a view of a sub-block of this view
+		quantity_field_view view(const index_type& sub_origin, const std::array<size_t,D>& count) const {
+			index_type o;
+			for(size_t d=0; d<D; ++d)
+				o[d] = origin[d]+sub_origin[d];
+			return quantity_field_view(base,map,o,count);
+		}
+
+		operator quantity_field_view<Dim,const plain_type,D,Layout,Align>() const {
+			return quantity_field_view<Dim,const plain_type,D,Layout,Align>(base,map,origin,n);
+		}
+
+	private:
+		element_type* base;
+		mapping_type map;
+		index_type origin;
+		std::array<size_t,D> n;
+	};
+
+}; // namespace dims
+
+#endif /* QUANTITY_FIELD_HPP_ */
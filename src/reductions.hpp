@@ -0,0 +1,167 @@
+#ifndef REDUCTIONS_HPP_
+#define REDUCTIONS_HPP_
+
+#include "dims.hpp"
+#include "vect.hpp"
+#include "parallel.hpp"
+
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+#include <vector>
+
+/*
+ * Parallel reductions over ranges of quantities. The results keep their
+ * dimensions, e.g. summing 0.5*m*dot(v,v) over a set of particles gives a
+ * quantity<work>.
+ *
+ * Ranges are given as random access iterators (pointers, std::vector
+ * iterators or quantity_span iterators). By default the range is split into
+ * one chunk per thread. With reduce_policy::reproducible the range is split
+ * into fixed size blocks whose partial results are combined in order, so
+ * the result is bitwise identical whatever the number of threads.
+ *
+ * The range reductions are named reduce_quantities, quantity_sum,
+ * quantity_min and quantity_max rather than after the std algorithms, whose
+ * unqualified calls on std iterators they would otherwise make ambiguous.
+ */
+
+namespace dims {
+
+	struct reduce_policy {
+		unsigned threads = 0;           // 0 uses all hardware threads
+		bool reproducible = false;      // fixed order blocked reduction
+		size_t block_size = 4096;       // elements per block in reproducible mode
+		size_t serial_cutoff = 1<<15;   // ranges shorter than this are reduced on the calling thread
+	};
+
+	/*
+	 * Element-wise helpers.
+	 */
+
+	// dot product of two vector quantities
+	template<class Dim1, class Dim2, size_t N, class T, class U>
+	quantity<typename mult_Dimension<Dim1,Dim2>::result,decltype(std::declval<T>()*std::declval<U>())>
+	dot(const quantity<Dim1,nvect<N,T>>& a, const quantity<Dim2,nvect<N,U>>& b) {
+		return quantity<typename mult_Dimension<Dim1,Dim2>::result,decltype(std::declval<T>()*std::declval<U>())>(discard_dims(a).dot(discard_dims(b)));
+	}
+
+	// dot product of scalars is just multiplication
+	template<class Dim1, class Dim2, class T, class U>
+	auto dot(const quantity<Dim1,T>& a, const quantity<Dim2,U>& b) -> decltype(a*b) {
+		return a*b;
+	}
+
+	/*
+	 * Reduce transform(x) over [first,last) with the associative operation
+	 * reduce, starting from init.
+	 */
+	template<class It, class T, class Reduce, class Transform>
+	T reduce_quantities(It first, It last, T init, Reduce reduce, Transform transform, const reduce_policy& policy = reduce_policy()) {
+		const size_t n = last-first;
+
+		// reduce [b,e), which must not be empty
+		auto partial = [&](size_t b, size_t e) -> T {
+			T acc = transform(first[b]);
+			for(size_t i=b+1; i<e; ++i)
+				acc = reduce(acc,transform(first[i]));
+			return acc;
+		};
+
+		size_t chunk;
+		if(policy.reproducible)
+			chunk = std::max<size_t>(policy.block_size,1);
+		else if(n<policy.serial_cutoff)
+			chunk = std::max<size_t>(n,1);
+		else {
+			const size_t threads = policy.threads ? policy.threads : default_threads();
+			chunk = (n+threads-1)/threads;
+		}
+
+		const size_t chunks = (n+chunk-1)/chunk;
+		if(chunks==0)
+			return init;
+		if(chunks==1)
+			return reduce(init,partial(0,n));
+
+		std::vector<T> partials(chunks);
+		const unsigned threads = n<policy.serial_cutoff ? 1 : policy.threads;
+		parallel_for(chunks,threads,[&](size_t c) {
+			partials[c] = partial(c*chunk,std::min(n,(c+1)*chunk));
+		});
+
+		T out = init;
+		for(const T& p : partials)
+			out = reduce(out,p);
+		return out;
+	}
+
+	template<class It>
+	using range_value_t = typename std::iterator_traits<It>::value_type;
+
+	/*
+	 * Sum of the elements, same dimensions as the elements.
+	 */
+	template<class It>
+	range_value_t<It> quantity_sum(It first, It last, const reduce_policy& policy = reduce_policy()) {
+		using Q = range_value_t<It>;
+		return reduce_quantities(first,last,Q(),std::plus<Q>(),[](const Q& q) { return q; },policy);
+	}
+
+	/*
+	 * Sum of dot(a[i],b[i]), the dimensions are the product of the two ranges'.
+	 */
+	template<class It1, class It2>
+	auto dot(It1 first1, It1 last1, It2 first2, const reduce_policy& policy = reduce_policy())
+	-> decltype(dot(std::declval<range_value_t<It1>>(),std::declval<range_value_t<It2>>())) {
+		using A = range_value_t<It1>;
+		using B = range_value_t<It2>;
+		using R = decltype(dot(std::declval<A>(),std::declval<B>()));
+
+		// iterate over indices so both ranges are advanced together
+		struct index_iterator {
+			size_t i;
+			size_t operator[](size_t j) const { return i+j; }
+			size_t operator-(const index_iterator& it) const { return i-it.i; }
+		};
+
+		return reduce_quantities(index_iterator{0},index_iterator{size_t(last1-first1)},R(),std::plus<R>(),
+			[&](size_t i) { return dot(A(first1[i]),B(first2[i])); },policy);
+	}
+
+	/*
+	 * Euclidean norm of the whole range, sqrt(sum dot(x,x)).
+	 */
+	template<class It>
+	auto norm(It first, It last, const reduce_policy& policy = reduce_policy())
+	-> decltype(sqrt(dot(std::declval<range_value_t<It>>(),std::declval<range_value_t<It>>()))) {
+		using Q = range_value_t<It>;
+		using R = decltype(dot(std::declval<Q>(),std::declval<Q>()));
+		return sqrt(reduce_quantities(first,last,R(),std::plus<R>(),[](const Q& q) { return dot(q,q); },policy));
+	}
+
+	/*
+	 * Smallest and largest elements (of scalar quantities). The range must not
+	 * be empty.
+	 */
+	template<class It>
+	range_value_t<It> quantity_min(It first, It last, const reduce_policy& policy = reduce_policy()) {
+		using Q = range_value_t<It>;
+		if(first==last)
+			throw std::invalid_argument("dims::quantity_min of an empty range");
+		const Q init = first[0];
+		return reduce_quantities(first,last,init,[](const Q& a, const Q& b) { return b<a ? b : a; },[](const Q& q) { return q; },policy);
+	}
+
+	template<class It>
+	range_value_t<It> quantity_max(It first, It last, const reduce_policy& policy = reduce_policy()) {
+		using Q = range_value_t<It>;
+		if(first==last)
+			throw std::invalid_argument("dims::quantity_max of an empty range");
+		const Q init = first[0];
+		return reduce_quantities(first,last,init,[](const Q& a, const Q& b) { return a<b ? b : a; },[](const Q& q) { return q; },policy);
+	}
+
+}; // namespace dims
+
+#endif /* REDUCTIONS_HPP_ */
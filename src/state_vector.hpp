@@ -0,0 +1,204 @@
+#ifndef STATE_VECTOR_HPP_
+#define STATE_VECTOR_HPP_
+
+#include <cstddef>
+#include <iostream>
+#include <tuple>
+#include <type_traits>
+
+#include "dims.hpp"
+#include "vect_simd.hpp"
+
+/*
+ * A vector of quantities with different dimensions, e.g. a phase-space
+ * point [position; momentum]. Each component has its own dimension but the
+ * values are stored contiguously as one T[N] block (laid out like
+ * nvect<N,T>) so whole-vector arithmetic goes through the nvect kernels.
+ *
+ *     state_vector<length,momentum> y(length_t<>(1.0),momentum_t<>(2.0));
+ *     length_t<> x = y.get<0>();
+ *     auto dydt = y/dims::time_t<>(0.5);  // state_vector<velocity,force>
+ *
+ * Multiplying or dividing by a quantity changes every component's
+ * dimensions in the same way.
+ */
+
+namespace dims {
+
+	template<class T, class... Dims>
+	class basic_state_vector {
+
+		static_assert(sizeof...(Dims)>0,"Cannot create an empty state vector");
+		using this_type = basic_state_vector<T,Dims...>;
+		using layout = nvect_layout<sizeof...(Dims),T>;
+		using kernels = nvect_kernels<sizeof...(Dims),T>;
+
+		template<class T2, class... Dims2> friend class basic_state_vector;
+
+	public:
+		typedef T value_type;
+
+		static constexpr size_t size() { return sizeof...(Dims); }
+
+		// the dimensions of component I
+		template<size_t I>
+		using dimension = typename std::tuple_element<I,std::tuple<Dims...>>::type;
+
+		// the same state with each component's dimensions multiplied by Dim2
+		template<class Dim2, class T2=T>
+		using scaled_type = basic_state_vector<T2,typename mult_Dimension<Dims,Dim2>::result...>;
+
+		// ensure the state vector is trivial like nvect
+		basic_state_vector() 								= default;
+		basic_state_vector(const this_type&) 				= default;
+		basic_state_vector(this_type&&) 					= default;
+		~basic_state_vector() 								= default;
+		this_type& operator=(const this_type&) 				= default;
+		this_type& operator=(this_type&&) 					= default;
+
+		// init from one quantity per component
+		explicit basic_state_vector(const quantity<Dims,T>&... qs) :values{discard_dims(qs)...} {}
+
+		/*
+		 * Component access
+		 */
+
+		template<size_t I>
+		quantity<dimension<I>,T> get() const {
+			return quantity<dimension<I>,T>(values[I]);
+		}
+
+		template<size_t I, class Dim2>
+		void set(const quantity<Dim2,T>& q) {
+			static_assert(std::is_same<dimension<I>,Dim2>::value,"Cannot assign quantities with different dimensions.");
+			values[I] = discard_dims(q);
+		}
+
+		// the raw contiguous block of size() values (discards dimensional safety)
+		T* data() { return values; }
+		const T* data() const { return values; }
+
+		/*
+		 * Whole-vector arithmetic
+		 */
+
+		this_type operator+(const this_type& rhs) const {
+			this_type out;
+			kernels::add(out.values,values,rhs.values);
+			return out;
+		}
+
+		this_type operator-(const this_type& rhs) const {
+			this_type out;
+			kernels::sub(out.values,values,rhs.values);
+			return out;
+		}
+
+		this_type& operator+=(const this_type& rhs) {
+			kernels::add(values,values,rhs.values);
+			return *this;
+		}
+
+		this_type& operator-=(const this_type& rhs) {
+			kernels::sub(values,values,rhs.values);
+			return *this;
+		}
+
+		// scaling by a quantity changes the dimensions of every component
+		template<class Dim2>
+		scaled_type<Dim2> operator*(const quantity<Dim2,T>& q) const {
+			scaled_type<Dim2> out;
+			kernels::scale(out.values,values,discard_dims(q));
+			return out;
+		}
+
+		template<class Dim2>
+		friend scaled_type<Dim2> operator*(const quantity<Dim2,T>& q, const this_type& s) {
+			return s*q;
+		}
+
+		template<class Dim2>
+		scaled_type<typename inv_Dimension<Dim2>::result> operator/(const quantity<Dim2,T>& q) const {
+			scaled_type<typename inv_Dimension<Dim2>::result> out;
+			kernels::divide(out.values,values,discard_dims(q));
+			return out;
+		}
+
+		// scaling by a raw number leaves the dimensions unchanged
+		this_type operator*(T s) const {
+			this_type out;
+			kernels::scale(out.values,values,s);
+			return out;
+		}
+
+		friend this_type operator*(T s, const this_type& v) {
+			return v*s;
+		}
+
+		this_type operator/(T s) const {
+			this_type out;
+			kernels::divide(out.values,values,s);
+			return out;
+		}
+
+		this_type& operator*=(T s) {
+			kernels::scale(values,values,s);
+			return *this;
+		}
+
+		this_type& operator/=(T s) {
+			kernels::divide(values,values,s);
+			return *this;
+		}
+
+		template<class Dim2>
+		this_type& operator*=(const quantity<Dim2,T>& q) {
+			static_assert(std::is_same<Dim2,typename make_list_from_type<list_length<Dim2>::value,std::ratio<0>>::type>::value,"Can only *= with dimensionless RHS");
+			kernels::scale(values,values,discard_dims(q));
+			return *this;
+		}
+
+		template<class Dim2>
+		this_type& operator/=(const quantity<Dim2,T>& q) {
+			static_assert(std::is_same<Dim2,typename make_list_from_type<list_length<Dim2>::value,std::ratio<0>>::type>::value,"Can only /= with dimensionless RHS");
+			kernels::divide(values,values,discard_dims(q));
+			return *this;
+		}
+
+		friend std::ostream& operator<<(std::ostream& out, const this_type& v) {
+			out << "[" << v.values[0];
+			for(size_t i=1; i<size(); ++i)
+				out << ";" << v.values[i];
+			return out << "]";
+		}
+
+	private:
+		// may be padded and over-aligned for SIMD, only the first size() are components
+		alignas(layout::alignment) T values[layout::padded];
+	};
+
+	template<class... Dims>
+	using state_vector = basic_state_vector<double,Dims...>;
+
+	// free get, also used by structured bindings
+	template<size_t I, class T, class... Dims>
+	quantity<typename basic_state_vector<T,Dims...>::template dimension<I>,T> get(const basic_state_vector<T,Dims...>& v) {
+		return v.template get<I>();
+	}
+
+}; // namespace dims
+
+// allows auto [x,p] = state;
+namespace std {
+
+	template<class T, class... Dims>
+	struct tuple_size<dims::basic_state_vector<T,Dims...>> : std::integral_constant<size_t,sizeof...(Dims)> {};
+
+	template<size_t I, class T, class... Dims>
+	struct tuple_element<I,dims::basic_state_vector<T,Dims...>> {
+		using type = dims::quantity<typename dims::basic_state_vector<T,Dims...>::template dimension<I>,T>;
+	};
+
+} // namespace std
+
+#endif /* STATE_VECTOR_HPP_ */
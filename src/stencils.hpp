@@ -0,0 +1,337 @@
+#ifndef STENCILS_HPP_
+#define STENCILS_HPP_
+
+#include "dims.hpp"
+#include "parallel.hpp"
+#include "quantity_field.hpp"
+#include "vect.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <stdexcept>
+#include <type_traits>
+
+/*
+ * Second order central difference operators on quantity_fields. The result
+ * dimensions follow from the input, e.g. the gradient of a pressure field is
+ * a pressure/length vector and its Laplacian a pressure/area:
+ *
+ *     quantity_field<pressure> p({nx,ny,nz},1);
+ *     quantity_field<IntDim<1,-2,-2>,nvect<3>> gp({nx,ny,nz});
+ *     quantity_field<IntDim<1,-3,-2>> lp({nx,ny,nz});
+ *     stencil::sweep({}, stencil::assign(gp,gradient(p,h)), stencil::assign(lp,laplacian(p,h)));
+ *
+ * Operators only read the interior and one ghost layer, so the ghosts must
+ * be filled (boundary conditions) before a sweep. sweep() evaluates all its
+ * assignments cell by cell over cache sized tiles of the grid, with the tiles
+ * shared between threads, so fusing several operators reads each input once
+ * per sweep. An output must not also be an input of the same sweep.
+ */
+
+namespace dims {
+
+	namespace stencil {
+
+		template<class Dim>
+		using per_length = typename mult_Dimension<Dim,typename inv_Dimension<length>::result>::result;
+
+		template<class Dim>
+		using per_area = typename mult_Dimension<Dim,typename inv_Dimension<area>::result>::result;
+
+		// grid spacing in each direction
+		template<size_t D>
+		using spacing = std::array<quantity<length>,D>;
+
+		template<size_t D>
+		spacing<D> uniform(const quantity<length>& h) {
+			spacing<D> out;
+			out.fill(h);
+			return out;
+		}
+
+		template<class Field>
+		void check_ghosts(const Field& f) {
+			if(f.ghost()<1)
+				throw std::invalid_argument("stencil: input fields need at least one ghost layer");
+		}
+
+		/*
+		 * Raw values of a field around one cell. The centre offset is computed
+		 * once and the neighbours are steps from it.
+		 */
+		template<class Field>
+		class neighbourhood {
+			static constexpr size_t D = Field::dimensions;
+			using T = typename Field::data_type;
+
+		public:
+			neighbourhood(const Field& f, const field_index<D>& i)
+			:map(f.mapping()), data(f.data()), i(i), o(map.offset(i)) {}
+
+			const T& centre() const {
+				return *reinterpret_cast<const T*>(data+o);
+			}
+
+			// the value s cells away along d
+			const T& at(size_t d, ptrdiff_t s) const {
+				return *reinterpret_cast<const T*>(data+map.neighbour(o,i,d,s));
+			}
+
+		private:
+			const typename Field::mapping_type& map;
+			const typename Field::value_type* data;
+			const field_index<D>& i;
+			size_t o;
+		};
+
+		/*
+		 * Operators. Each is a small view holding the input field and the raw
+		 * reciprocal spacings, evaluated with op(i) for an interior index i.
+		 */
+
+		template<class Field>
+		class gradient_op {
+			static constexpr size_t D = Field::dimensions;
+			using T = typename Field::data_type;
+			using Dim = typename Field::dimension;
+
+		public:
+			using result_type = quantity<per_length<Dim>,nvect<D,T>>;
+			using index_type = field_index<D>;
+
+			gradient_op(const Field& f, const spacing<D>& h) :f(f) {
+				check_ghosts(f);
+				for(size_t d=0; d<D; ++d)
+					inv2h[d] = 0.5/discard_dims(h[d]);
+			}
+
+			result_type operator()(const index_type& i) const {
+				const neighbourhood<Field> nb(f,i);
+				nvect<D,T> out;
+				for(size_t d=0; d<D; ++d)
+					out[d] = (nb.at(d,1) - nb.at(d,-1))*inv2h[d];
+				return result_type(out);
+			}
+
+			const std::array<size_t,D>& extents() const { return f.extents(); }
+
+		private:
+			const Field& f;
+			std::array<double,D> inv2h;
+		};
+
+		template<class Field>
+		class divergence_op {
+			static constexpr size_t D = Field::dimensions;
+			using V = typename Field::data_type;
+			using T = typename std::decay<decltype(std::declval<V>()[0])>::type;
+			using Dim = typename Field::dimension;
+
+			static_assert(std::is_same<V,nvect<D,T>>::value,"divergence needs a field of nvect<D,T> on a D dimensional grid");
+
+		public:
+			using result_type = quantity<per_length<Dim>,T>;
+			using index_type = field_index<D>;
+
+			divergence_op(const Field& f, const spacing<D>& h) :f(f) {
+				check_ghosts(f);
+				for(size_t d=0; d<D; ++d)
+					inv2h[d] = 0.5/discard_dims(h[d]);
+			}
+
+			result_type operator()(const index_type& i) const {
+				const neighbourhood<Field> nb(f,i);
+				T out = T();
+				for(size_t d=0; d<D; ++d)
+					out += (nb.at(d,1)[d] - nb.at(d,-1)[d])*inv2h[d];
+				return result_type(out);
+			}
+
+			const std::array<size_t,D>& extents() const { return f.extents(); }
+
+		private:
+			const Field& f;
+			std::array<double,D> inv2h;
+		};
+
+		template<class Field>
+		class curl_op {
+			using V = typename Field::data_type;
+			using T = typename std::decay<decltype(std::declval<V>()[0])>::type;
+			using Dim = typename Field::dimension;
+
+			static_assert(Field::dimensions==3 && std::is_same<V,nvect<3,T>>::value,"curl needs a field of nvect<3,T> on a 3 dimensional grid");
+
+		public:
+			using result_type = quantity<per_length<Dim>,nvect<3,T>>;
+			using index_type = field_index<3>;
+
+			curl_op(const Field& f, const spacing<3>& h) :f(f) {
+				check_ghosts(f);
+				for(size_t d=0; d<3; ++d)
+					inv2h[d] = 0.5/discard_dims(h[d]);
+			}
+
+			result_type operator()(const index_type& i) const {
+				const neighbourhood<Field> nb(f,i);
+				// d(component c)/d(direction d)
+				auto ddx = [&](size_t c, size_t d) {
+					return (nb.at(d,1)[c] - nb.at(d,-1)[c])*inv2h[d];
+				};
+				return result_type(ddx(2,1)-ddx(1,2), ddx(0,2)-ddx(2,0), ddx(1,0)-ddx(0,1));
+			}
+
+			const std::array<size_t,3>& extents() const { return f.extents(); }
+
+		private:
+			const Field& f;
+			std::array<double,3> inv2h;
+		};
+
+		template<class Field>
+		class laplacian_op {
+			static constexpr size_t D = Field::dimensions;
+			using T = typename Field::data_type;
+			using Dim = typename Field::dimension;
+
+		public:
+			using result_type = quantity<per_area<Dim>,T>;
+			using index_type = field_index<D>;
+
+			laplacian_op(const Field& f, const spacing<D>& h) :f(f) {
+				check_ghosts(f);
+				for(size_t d=0; d<D; ++d)
+					inv_h2[d] = 1.0/(discard_dims(h[d])*discard_dims(h[d]));
+			}
+
+			result_type operator()(const index_type& i) const {
+				const neighbourhood<Field> nb(f,i);
+				const T c = nb.centre();
+				T out = T();
+				for(size_t d=0; d<D; ++d)
+					out += (nb.at(d,1) + nb.at(d,-1) - c*2.0)*inv_h2[d];
+				return result_type(out);
+			}
+
+			const std::array<size_t,D>& extents() const { return f.extents(); }
+
+		private:
+			const Field& f;
+			std::array<double,D> inv_h2;
+		};
+
+		// writes op(i) to out[i], the dimensions must match
+		template<class Out, class Op>
+		struct assignment {
+			static constexpr size_t dimensions = Out::dimensions;
+			Out& out;
+			Op op;
+
+			void operator()(const field_index<Out::dimensions>& i) const {
+				out[i] = op(i);
+			}
+		};
+
+		template<class Out, class Op>
+		assignment<Out,Op> assign(Out& out, const Op& op) {
+			static_assert(std::is_same<typename Out::value_type,typename Op::result_type>::value,"Cannot assign a stencil result with different dimensions.");
+			return assignment<Out,Op>{out,op};
+		}
+
+		struct sweep_options {
+			unsigned threads = 0;   // 0 for all hardware threads
+			size_t tile = 16;       // tile extent in each but the fastest direction, which is not split (0 acts as 1)
+		};
+
+		/*
+		 * Evaluates every assignment at every interior cell. The grid is cut
+		 * into tiles which are handed out to the threads, and within a tile all
+		 * the assignments are applied to a cell before moving on.
+		 */
+		template<class A, class... As>
+		void sweep(const sweep_options& opts, const A& a, const As&... as) {
+			constexpr size_t D = A::dimensions;
+			const std::array<size_t,D>& n = a.out.extents();
+			const bool same = (... && (as.out.extents()==n && as.op.extents()==n)) && a.op.extents()==n;
+			if(!same)
+				throw std::invalid_argument("stencil: all fields in a sweep must have the same extents");
+
+			// tile extent and number of tiles in each direction
+			std::array<size_t,D> extent, tiles;
+			size_t count = 1;
+			for(size_t d=0; d<D; ++d) {
+				extent[d] = d==D-1 ? std::max<size_t>(n[d],1) : std::max<size_t>(opts.tile,1);
+				tiles[d] = (n[d]+extent[d]-1)/extent[d];
+				count *= tiles[d];
+			}
+
+			parallel_for(count,opts.threads,[&](size_t tile) {
+				field_index<D> lo, hi;
+				for(size_t d=D; d-->0;) {
+					const size_t t = extent[d];
+					lo[d] = ptrdiff_t((tile % tiles[d])*t);
+					hi[d] = std::min<ptrdiff_t>(lo[d]+t,n[d]);
+					tile /= tiles[d];
+				}
+
+				field_index<D> i = lo;
+				for(;;) {
+					for(i[D-1]=lo[D-1]; i[D-1]<hi[D-1]; ++i[D-1]) {
+						a(i);
+						(as(i), ...);
+					}
+					size_t d = D-1;
+					while(d-->0) {
+						if(++i[d] < hi[d])
+							break;
+						i[d] = lo[d];
+					}
+					if(d==size_t(-1))
+						return;
+				}
+			});
+		}
+
+	} // namespace stencil
+
+	/*
+	 * Operator factories, found by ADL on the field type.
+	 */
+
+	template<class Dim, class T, size_t D, class L, size_t A>
+	stencil::gradient_op<quantity_field<Dim,T,D,L,A>> gradient(const quantity_field<Dim,T,D,L,A>& f, const stencil::spacing<D>& h) {
+		return stencil::gradient_op<quantity_field<Dim,T,D,L,A>>(f,h);
+	}
+
+	template<class Dim, class T, size_t D, class L, size_t A>
+	stencil::divergence_op<quantity_field<Dim,T,D,L,A>> divergence(const quantity_field<Dim,T,D,L,A>& f, const stencil::spacing<D>& h) {
+		return stencil::divergence_op<quantity_field<Dim,T,D,L,A>>(f,h);
+	}
+
+	template<class Dim, class T, class L, size_t A>
+	stencil::curl_op<quantity_field<Dim,T,3,L,A>> curl(const quantity_field<Dim,T,3,L,A>& f, const stencil::spacing<3>& h) {
+		return stencil::curl_op<quantity_field<Dim,T,3,L,A>>(f,h);
+	}
+
+	template<class Dim, class T, size_t D, class L, size_t A>
+	stencil::laplacian_op<quantity_field<Dim,T,D,L,A>> laplacian(const quantity_field<Dim,T,D,L,A>& f, const stencil::spacing<D>& h) {
+		return stencil::laplacian_op<quantity_field<Dim,T,D,L,A>>(f,h);
+	}
+
+	// uniform spacing in every direction
+	template<class Dim, class T, size_t D, class L, size_t A>
+	auto gradient(const quantity_field<Dim,T,D,L,A>& f, const quantity<length>& h) { return gradient(f,stencil::uniform<D>(h)); }
+
+	template<class Dim, class T, size_t D, class L, size_t A>
+	auto divergence(const quantity_field<Dim,T,D,L,A>& f, const quantity<length>& h) { return divergence(f,stencil::uniform<D>(h)); }
+
+	template<class Dim, class T, class L, size_t A>
+	auto curl(const quantity_field<Dim,T,3,L,A>& f, const quantity<length>& h) { return curl(f,stencil::uniform<3>(h)); }
+
+	template<class Dim, class T, size_t D, class L, size_t A>
+	auto laplacian(const quantity_field<Dim,T,D,L,A>& f, const quantity<length>& h) { return laplacian(f,stencil::uniform<D>(h)); }
+
+}; // namespace dims
+
+#endif /* STENCILS_HPP_ */
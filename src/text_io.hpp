@@ -0,0 +1,382 @@
+#ifndef TEXT_IO_HPP_
+#define TEXT_IO_HPP_
+
+#include "dims.hpp"
+#include "units.hpp"
+#include "unit_parser.hpp"
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+/*
+ * Delimited text (CSV) import and export of columns of quantity<Dim,T> and
+ * unit<Dim,System,T>, using std::from_chars/std::to_chars rather than
+ * iostream formatting.
+ *
+ * The first line of a file names the columns and gives their units in
+ * brackets, e.g.
+ *
+ *     t [s],x [m],v [ft/s]
+ *
+ * A reader binds named columns to vectors of typed elements. The units of
+ * each bound column are parsed and checked against its dimensions once,
+ * then every value is parsed and multiplied by the conversion factor into
+ * the element's system (SI for quantities) straight into the vector:
+ *
+ *     std::vector<dims::time_t<>> t;
+ *     std::vector<units::unit<velocity,si_system>> v;
+ *     text_io::reader in(file);
+ *     in.read(text_io::col("t",t),text_io::col("v",v)); // v is converted from ft/s
+ *
+ * A column with no unit is dimensionless. Errors throw std::runtime_error
+ * (or dims::dimension_error for a column with the wrong dimensions).
+ */
+
+namespace dims {
+
+	namespace text_io {
+
+		/*
+		 * Description of the element types which can be read and written.
+		 */
+		template<class Q>
+		struct element_traits;
+
+		template<class Dim, class T>
+		struct element_traits<quantity<Dim,T>> {
+			using dimension = Dim;
+			using system = units::si_system;
+			using value_type = T;
+			static quantity<Dim,T> make(T t) { return quantity<Dim,T>(t); }
+			static T raw(const quantity<Dim,T>& q) { return discard_dims(q); }
+		};
+
+		template<class Dim, class System, class T>
+		struct element_traits<units::unit<Dim,System,T>> {
+			using dimension = Dim;
+			using system = System;
+			using value_type = T;
+			static units::unit<Dim,System,T> make(T t) { return units::unit<Dim,System,T>(t); }
+			static T raw(const units::unit<Dim,System,T>& u) { return discard_units(u); }
+		};
+
+		// a named column of elements, Vector is a (possibly const) std::vector
+		template<class Vector>
+		struct column {
+			std::string_view name;
+			Vector& data;
+		};
+
+		template<class Vector>
+		column<Vector> col(std::string_view name, Vector& data) {
+			return column<Vector>{name,data};
+		}
+
+		/*
+		 * Format q into [first,last) in the shortest form which reads back
+		 * exactly, optionally followed by a space and its unit symbol.
+		 */
+		template<class Q, class traits = element_traits<Q>>
+		std::to_chars_result to_chars(char* first, char* last, const Q& q, bool with_symbol = false) {
+			std::to_chars_result r = std::to_chars(first,last,traits::raw(q));
+			if(r.ec!=std::errc() || !with_symbol)
+				return r;
+
+			const std::string& symbol = units::unit_symbol<typename traits::dimension,typename traits::system>();
+			if((size_t)(last-r.ptr)<symbol.size()+1)
+				return {last,std::errc::value_too_large};
+			*r.ptr++ = ' ';
+			r.ptr = std::copy(symbol.begin(),symbol.end(),r.ptr);
+			return r;
+		}
+
+		inline std::string_view trim(std::string_view s) {
+			while(!s.empty() && (s.front()==' ' || s.front()=='\t'))
+				s.remove_prefix(1);
+			while(!s.empty() && (s.back()==' ' || s.back()=='\t' || s.back()=='\r'))
+				s.remove_suffix(1);
+			return s;
+		}
+
+		/*
+		 * Reads a delimited file in chunks. The header is read on construction.
+		 */
+		class reader {
+		public:
+			explicit reader(std::istream& in, char delimiter = ',', size_t chunk = 1<<16)
+			:in(in), delimiter(delimiter), chunk(chunk), begin(0), end(0), line_number(0), eof(false) {
+				buffer.resize(chunk);
+
+				std::string_view line;
+				if(!next_line(line))
+					throw std::runtime_error("text_io: missing header line");
+				for(std::string_view field : split(line)) {
+					field = trim(field);
+					std::string_view unit;
+					const size_t open = field.find('[');
+					if(open!=std::string_view::npos) {
+						const size_t close = field.find(']',open);
+						if(close==std::string_view::npos)
+							throw std::runtime_error("text_io: missing ']' in header field '" + std::string(field) + "'");
+						unit = trim(field.substr(open+1,close-open-1));
+						field = trim(field.substr(0,open));
+					}
+					header_names.emplace_back(field);
+					header_units.emplace_back(unit);
+				}
+				fields.resize(header_names.size());
+			}
+
+			const std::vector<std::string>& names() const { return header_names; }
+			const std::vector<std::string>& unit_strings() const { return header_units; }
+
+			/*
+			 * Append up to max_rows rows to the bound columns, returns the number of
+			 * rows read (less than max_rows at the end of the file).
+			 */
+			template<class... Vectors>
+			size_t read_n(size_t max_rows, column<Vectors>... cols) {
+				constexpr size_t K = sizeof...(Vectors);
+				const std::array<size_t,K> index = {find(cols.name)...};
+				const std::array<double,K> factor = {check(cols)...};
+
+				size_t rows = 0;
+				std::string_view line;
+				while(rows<max_rows && next_line(line)) {
+					if(trim(line).empty())
+						continue;
+					split_fields(line);
+					size_t k = 0;
+					((append(cols.data,fields[index[k]],factor[k],cols.name),++k),...);
+					++rows;
+				}
+				return rows;
+			}
+
+			// append all remaining rows to the bound columns
+			template<class... Vectors>
+			size_t read(column<Vectors>... cols) {
+				return read_n((size_t)-1,cols...);
+			}
+
+		private:
+			size_t find(std::string_view name) const {
+				for(size_t i=0; i<header_names.size(); ++i)
+					if(header_names[i]==name)
+						return i;
+				throw std::runtime_error("text_io: no column named '" + std::string(name) + "'");
+			}
+
+			// the factor converting the column's units into the element's system
+			template<class Vector>
+			double check(const column<Vector>& c) const {
+				using traits = element_traits<typename Vector::value_type>;
+				using Dim = typename traits::dimension;
+				const std::string& unit = header_units[find(c.name)];
+				if(unit.empty()) {
+					if(dimension_of<Dim>()!=dynamic_dimension())
+						throw dimension_error("text_io: column '" + std::string(c.name) + "' has no units but "
+											  + dimension_of<Dim>().to_string(list_length<Dim>::value) + " was expected");
+					return 1.0;
+				}
+				return units::factor_for<Dim,typename traits::system>(unit);
+			}
+
+			template<class Vector>
+			void append(Vector& data, std::string_view field, double factor, std::string_view name) {
+				using Q = typename Vector::value_type;
+				using traits = element_traits<Q>;
+				using T = typename traits::value_type;
+
+				field = trim(field);
+				T t;
+				const std::from_chars_result r = std::from_chars(field.data(),field.data()+field.size(),t);
+				if(r.ec!=std::errc() || r.ptr!=field.data()+field.size())
+					throw std::runtime_error("text_io: line " + std::to_string(line_number) + ": cannot parse '"
+											 + std::string(field) + "' in column '" + std::string(name) + "'");
+				if(factor!=1.0)
+					t = (T)(t*factor);
+				data.push_back(traits::make(t));
+			}
+
+			std::vector<std::string_view> split(std::string_view line) const {
+				std::vector<std::string_view> out;
+				for(size_t start=0;;) {
+					const size_t stop = line.find(delimiter,start);
+					out.push_back(line.substr(start,stop-start));
+					if(stop==std::string_view::npos)
+						return out;
+					start = stop+1;
+				}
+			}
+
+			// split into the preallocated fields, which must all be present
+			void split_fields(std::string_view line) {
+				size_t start = 0;
+				for(size_t i=0; i<fields.size(); ++i) {
+					const size_t stop = line.find(delimiter,start);
+					if(stop==std::string_view::npos && i+1<fields.size())
+						throw std::runtime_error("text_io: line " + std::to_string(line_number) + ": expected "
+												 + std::to_string(fields.size()) + " fields");
+					fields[i] = line.substr(start,stop-start);
+					start = stop+1;
+				}
+			}
+
+			// the next line without its newline, valid until the following call
+			bool next_line(std::string_view& line) {
+				for(;;) {
+					const char* first = buffer.data()+begin;
+					const void* nl = std::memchr(first,'\n',end-begin);
+					if(nl) {
+						const size_t n = static_cast<const char*>(nl)-first;
+						line = std::string_view(first,n);
+						begin += n+1;
+						++line_number;
+						return true;
+					}
+					if(eof) {
+						if(begin==end)
+							return false;
+						line = std::string_view(first,end-begin); // last line with no newline
+						begin = end;
+						++line_number;
+						return true;
+					}
+
+					// move the partial line to the front and read another chunk
+					std::memmove(&buffer[0],first,end-begin);
+					end -= begin;
+					begin = 0;
+					if(buffer.size()-end<chunk/2)
+						buffer.resize(2*buffer.size());
+					in.read(&buffer[end],buffer.size()-end);
+					end += in.gcount();
+					eof = !in;
+				}
+			}
+
+			std::istream& in;
+			char delimiter;
+			size_t chunk;
+			std::string buffer;
+			size_t begin, end;
+			size_t line_number;
+			bool eof;
+
+			std::vector<std::string> header_names;
+			std::vector<std::string> header_units;
+			std::vector<std::string_view> fields;
+		};
+
+		/*
+		 * Writes columns of equal length, formatting into a buffer which is
+		 * flushed to the stream in large blocks.
+		 */
+		class writer {
+		public:
+			explicit writer(std::ostream& out, char delimiter = ',', size_t buffer_size = 1<<16)
+			:out(out), delimiter(delimiter), buffer(std::max<size_t>(buffer_size,256)), used(0) {}
+
+			writer(const writer&) = delete;
+			writer& operator=(const writer&) = delete;
+
+			~writer() { flush(); }
+
+			// "name [symbol]" for each column
+			template<class... Vectors>
+			void write_header(column<Vectors>... cols) {
+				bool first = true;
+				(header_field(cols,first),...);
+				put('\n');
+			}
+
+			template<class... Vectors>
+			void write_rows(column<Vectors>... cols) {
+				const size_t sizes[] = {cols.data.size()...};
+				for(size_t s : sizes)
+					if(s!=sizes[0])
+						throw std::invalid_argument("text_io: columns have different lengths");
+
+				for(size_t i=0; i<sizes[0]; ++i) {
+					bool first = true;
+					(value_field(cols.data[i],first),...);
+					put('\n');
+				}
+			}
+
+			template<class... Vectors>
+			void write(column<Vectors>... cols) {
+				write_header(cols...);
+				write_rows(cols...);
+			}
+
+			void flush() {
+				out.write(buffer.data(),used);
+				used = 0;
+				out.flush();
+			}
+
+		private:
+			template<class Vector>
+			void header_field(const column<Vector>& c, bool& first) {
+				using traits = element_traits<typename std::decay<typename Vector::value_type>::type>;
+				if(!first)
+					put(delimiter);
+				first = false;
+				append(c.name);
+				const std::string& symbol = units::unit_symbol<typename traits::dimension,typename traits::system>();
+				if(symbol!="1") {
+					append(" [");
+					append(symbol);
+					put(']');
+				}
+			}
+
+			template<class Q>
+			void value_field(const Q& q, bool& first) {
+				if(!first)
+					put(delimiter);
+				first = false;
+				reserve(64);
+				const std::to_chars_result r = text_io::to_chars(&buffer[used],buffer.data()+buffer.size(),q);
+				if(r.ec!=std::errc())
+					throw std::runtime_error("text_io: formatting failed");
+				used = r.ptr-buffer.data();
+			}
+
+			void reserve(size_t n) {
+				if(buffer.size()-used<n)
+					flush();
+			}
+
+			void put(char c) {
+				reserve(1);
+				buffer[used++] = c;
+			}
+
+			void append(std::string_view s) {
+				for(char c : s)
+					put(c);
+			}
+
+			std::ostream& out;
+			char delimiter;
+			std::vector<char> buffer;
+			size_t used;
+		};
+
+	}; // namespace text_io
+
+}; // namespace dims
+
+#endif /* TEXT_IO_HPP_ */
@@ -0,0 +1,62 @@
+#ifndef UNIT_CONVERT_HPP_
+#define UNIT_CONVERT_HPP_
+
+#include "units.hpp"
+
+#include <cstddef>
+#include <vector>
+
+/*
+ * Bulk conversion between unit systems. Each function multiplies by the
+ * single compile time factor from units::conversion, in a loop the compiler
+ * can vectorize (the input and output must not overlap unless noted).
+ *
+ * As with conversion_factor the target system comes first, e.g.
+ *
+ *     convert_values<dims::length,si_system,cgs_system>(cm,m,n); // cm -> m
+ */
+
+namespace units
+{
+
+	// convert n raw values of dimension Dim from System2 to System1
+	template<class Dim, class System1, class System2, class T>
+	void convert_values(const T* __restrict in, T* __restrict out, size_t n) {
+		constexpr T factor = conversion<Dim,System1,System2>::factor;
+		for(size_t i=0; i<n; ++i)
+			out[i] = in[i]*factor;
+	}
+
+	// convert n raw values of dimension Dim from System2 to System1 in place
+	template<class Dim, class System1, class System2, class T>
+	void convert_values(T* data, size_t n) {
+		constexpr T factor = conversion<Dim,System1,System2>::factor;
+		for(size_t i=0; i<n; ++i)
+			data[i] *= factor;
+	}
+
+	// convert n units to System1
+	template<class System1, class Dim, class System2, class T>
+	void convert_units(const unit<Dim,System2,T>* __restrict in, unit<Dim,System1,T>* __restrict out, size_t n) {
+		for(size_t i=0; i<n; ++i)
+			out[i] = unit<Dim,System1,T>(in[i]);
+	}
+
+	template<class System1, class Dim, class System2, class T>
+	std::vector<unit<Dim,System1,T>> convert_units(const std::vector<unit<Dim,System2,T>>& in) {
+		std::vector<unit<Dim,System1,T>> out(in.size());
+		convert_units<System1>(in.data(),out.data(),in.size());
+		return out;
+	}
+
+	// convert raw values of dimension Dim in System2 straight into units in System1
+	template<class System1, class Dim, class System2, class T>
+	void convert_units(const T* __restrict in, unit<Dim,System1,T>* __restrict out, size_t n) {
+		constexpr T factor = conversion<Dim,System1,System2>::factor;
+		for(size_t i=0; i<n; ++i)
+			out[i] = unit<Dim,System1,T>(in[i]*factor);
+	}
+
+} // namespace units
+
+#endif /* UNIT_CONVERT_HPP_ */
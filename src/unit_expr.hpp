@@ -0,0 +1,198 @@
+#ifndef UNIT_EXPR_HPP_
+#define UNIT_EXPR_HPP_
+
+#include "units.hpp"
+
+#include <type_traits>
+
+/*
+ * Deferred conversion for products of units in different systems.
+ *
+ * unit::operator* and operator/ convert the right hand side into the left
+ * hand system at every step, so a chain mixing cgs, SI and imperial values
+ * multiplies by several conversion factors. Wrapping the first operand in
+ * deferred() instead multiplies the raw values only, and records in the type
+ * which dimensions came from which system. The conversion is applied when
+ * the product is assigned to a unit, as one factor combined at compile time:
+ *
+ *     unit<force,si_system> F = deferred(m_lb)*a_cgs/t_s*v_ft; // one multiply by the factor
+ *
+ * Like conversion_factor the combined factor keeps exact numerators and
+ * denominators separate, so it is rounded once.
+ */
+
+namespace units
+{
+
+	// the part of a product's dimensions whose values are in System
+	template<class System, class Dim>
+	struct system_term {
+		using system = System;
+		using dimension = Dim;
+	};
+
+	namespace deferred_impl
+	{
+
+		// add Dim to the term for System, or append a new term
+		template<class Terms, class System, class Dim>
+		struct add_term {
+			using head = typename Terms::value;
+			using type = typename std::conditional<
+				std::is_same<typename head::system,System>::value,
+				lists::list_element<system_term<System,typename dims::mult_Dimension<typename head::dimension,Dim>::result>,typename Terms::tail>,
+				lists::list_element<head,typename add_term<typename Terms::tail,System,Dim>::type>
+			>::type;
+		};
+
+		template<class System, class Dim>
+		struct add_term<lists::end_element,System,Dim> {
+			using type = lists::list_element<system_term<System,Dim>,lists::end_element>;
+		};
+
+		// the terms of the product of two expressions (Inv to divide by the second)
+		template<class Terms1, class Terms2, bool Inv>
+		struct merge_terms {
+			using head = typename Terms2::value;
+			using dim = typename std::conditional<Inv,typename dims::inv_Dimension<typename head::dimension>::result,typename head::dimension>::type;
+			using type = typename merge_terms<typename add_term<Terms1,typename head::system,dim>::type,typename Terms2::tail,Inv>::type;
+		};
+
+		template<class Terms1, bool Inv>
+		struct merge_terms<Terms1,lists::end_element,Inv> {
+			using type = Terms1;
+		};
+
+		// the combined factor converting every term into System
+		template<class Terms, class System>
+		struct combined_conversion {
+			using head = conversion<typename Terms::value::dimension,System,typename Terms::value::system>;
+			using tail = combined_conversion<typename Terms::tail,System>;
+
+			static constexpr long double num = head::num*tail::num;
+			static constexpr long double den = head::den*tail::den;
+			static constexpr long double inexact = head::inexact*tail::inexact;
+		};
+
+		template<class System>
+		struct combined_conversion<lists::end_element,System> {
+			static constexpr long double num = 1.0L;
+			static constexpr long double den = 1.0L;
+			static constexpr long double inexact = 1.0L;
+		};
+
+	} // namespace deferred_impl
+
+	/*
+	 * A product of units from any systems. val is the product of the raw
+	 * values, each still in its own system.
+	 */
+	template<class Dim, class Terms, class T>
+	class unit_product {
+		T val;
+		using this_type = unit_product<Dim,Terms,T>;
+
+		template<class Dim2, class Terms2, class T2> friend class unit_product;
+
+	public:
+		using dimension = Dim;
+		using terms = Terms;
+
+		constexpr explicit unit_product(T t) :val(t) {}
+
+		// the single factor converting the product into System
+		template<class System>
+		static constexpr double factor() {
+			using c = deferred_impl::combined_conversion<Terms,System>;
+			return (c::num<=9007199254740992.0L && c::den<=9007199254740992.0L)
+			       ? (double)((double)c::num/(double)c::den*(double)c::inexact)
+			       : (double)(c::num/c::den*c::inexact);
+		}
+
+		// the raw value in System, one multiply (none if the factor is 1)
+		template<class System>
+		constexpr T value_in() const {
+			constexpr double f = factor<System>();
+			if constexpr(f==1.0)
+				return val;
+			else
+				return val*f;
+		}
+
+		template<class System>
+		constexpr unit<Dim,System,T> in() const {
+			return unit<Dim,System,T>(value_in<System>());
+		}
+
+		/*
+		 * Multiplying and dividing only combines the terms, the values are not
+		 * converted.
+		 */
+
+		template<class Dim2, class Terms2, class T2>
+		using mult_type = unit_product<typename dims::mult_Dimension<Dim,Dim2>::result,
+		                               typename deferred_impl::merge_terms<Terms,Terms2,false>::type,
+		                               decltype(std::declval<T>()*std::declval<T2>())>;
+
+		template<class Dim2, class Terms2, class T2>
+		using div_type = unit_product<typename dims::mult_Dimension<Dim,typename dims::inv_Dimension<Dim2>::result>::result,
+		                              typename deferred_impl::merge_terms<Terms,Terms2,true>::type,
+		                              decltype(std::declval<T>()/std::declval<T2>())>;
+
+		template<class Dim2, class Terms2, class T2>
+		constexpr mult_type<Dim2,Terms2,T2> operator*(const unit_product<Dim2,Terms2,T2>& rhs) const {
+			return mult_type<Dim2,Terms2,T2>(val*rhs.val);
+		}
+
+		template<class Dim2, class Terms2, class T2>
+		constexpr div_type<Dim2,Terms2,T2> operator/(const unit_product<Dim2,Terms2,T2>& rhs) const {
+			return div_type<Dim2,Terms2,T2>(val/rhs.val);
+		}
+
+		// a plain unit joins the product with its own system
+		template<class Dim2, class System2, class T2>
+		constexpr auto operator*(const unit<Dim2,System2,T2>& u) const {
+			return *this*deferred(u);
+		}
+
+		template<class Dim2, class System2, class T2>
+		constexpr auto operator/(const unit<Dim2,System2,T2>& u) const {
+			return *this/deferred(u);
+		}
+
+		template<class Dim2, class System2, class T2>
+		friend constexpr auto operator*(const unit<Dim2,System2,T2>& u, const this_type& p) {
+			return deferred(u)*p;
+		}
+
+		template<class Dim2, class System2, class T2>
+		friend constexpr auto operator/(const unit<Dim2,System2,T2>& u, const this_type& p) {
+			return deferred(u)/p;
+		}
+
+		// scaling by a raw number
+		constexpr this_type operator*(T s) const { return this_type(val*s); }
+		constexpr this_type operator/(T s) const { return this_type(val/s); }
+		friend constexpr this_type operator*(T s, const this_type& p) { return p*s; }
+
+		// the raw product with no conversion applied (discards units)
+		friend constexpr T discard_units(const this_type& p) {
+			return p.val;
+		}
+	};
+
+	// start a deferred product from a unit
+	template<class Dim, class System, class T>
+	constexpr unit_product<Dim,lists::list_element<system_term<System,Dim>,lists::end_element>,T> deferred(const unit<Dim,System,T>& u) {
+		return unit_product<Dim,lists::list_element<system_term<System,Dim>,lists::end_element>,T>(discard_units(u));
+	}
+
+	// the factor a deferred product will be multiplied by when assigned to System
+	template<class System, class Dim, class Terms, class T>
+	constexpr double deferred_factor(const unit_product<Dim,Terms,T>&) {
+		return unit_product<Dim,Terms,T>::template factor<System>();
+	}
+
+} // namespace units
+
+#endif /* UNIT_EXPR_HPP_ */
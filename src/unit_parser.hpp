@@ -0,0 +1,419 @@
+#ifndef UNIT_PARSER_HPP_
+#define UNIT_PARSER_HPP_
+
+#include "units.hpp"
+#include "dynamic_quantity.hpp"
+
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+/*
+ * Parsing of unit strings such as "kg*m/s^2", "g/cm^3" or "ft" into their
+ * dimensions and the factor which converts values in those units into a
+ * target unit system, e.g.
+ *
+ *     unit_plan p = plan_for<si_system>("g/cm^3"); // p.factor==1000, p.dimension==dimension_of<density>()
+ *
+ * The grammar is products and quotients of unit symbols, each with an
+ * optional integer or parenthesised rational power, with parentheses for
+ * grouping: "kg m^2 / (s^2)", "m^(1/2)", "1/s". The symbols are those of the
+ * base units in units.hpp (kg, g, lb, m, cm, ft, s, K, degR, mol, A, cd and
+ * rad when angle is a base dimension).
+ *
+ * plan_for<System> caches plans in a fixed size lock-free hash table, one
+ * per target system, so a repeated string costs one hash and one compare.
+ * Neither parsing nor lookups allocate, except to report an error.
+ *
+ * unit_symbol<Dim,System>() goes the other way, formatting the units of
+ * unit<Dim,System> in the same grammar.
+ */
+
+namespace units
+{
+
+	// thrown for a malformed or unknown unit string
+	struct unit_parse_error : std::invalid_argument {
+		using std::invalid_argument::invalid_argument;
+	};
+
+	/*
+	 * The result of parsing: the dimensions and the factor converting a value
+	 * in the parsed units into the target system (SI for parse_unit).
+	 */
+	struct unit_plan {
+		dims::dynamic_dimension dimension;
+		double factor;
+	};
+
+	namespace parser
+	{
+
+		struct symbol {
+			const char* name;
+			size_t base;        // index of the base dimension
+			double si;          // the size of the unit in SI units
+		};
+
+		// the base units of the predefined systems
+		constexpr symbol symbols[] = {
+			{"kg", 0, 1.0},
+			{"g",  0, convert<si::kg_t,cgs::g_t>::factor()},
+			{"lb", 0, convert<si::kg_t,imperial::lb_t>::factor()},
+			{"m",  1, 1.0},
+			{"cm", 1, convert<si::m_t,cgs::cm_t>::factor()},
+			{"ft", 1, convert<si::m_t,imperial::ft_t>::factor()},
+			{"s",  2, 1.0},
+			{"K",  3, 1.0},
+			{"degR", 3, convert<si::K_t,imperial::R_t>::factor()},
+			{"mol", 4, 1.0},
+			{"A",  5, 1.0},
+			{"cd", 6, 1.0},
+#if defined(DIMS_ANGLE_DIMENSION)
+			{"rad", 7, 1.0},
+#endif
+		};
+
+		// sizes of a system's base units in SI units
+		template<class System, class SI = si_system, size_t I = 0>
+		struct base_factors {
+			static void fill(std::array<double,dims::dynamic_dimension::max_base_dims>& out) {
+				out[I] = convert<typename SI::value,typename System::value>::factor();
+				base_factors<typename System::tail,typename SI::tail,I+1>::fill(out);
+			}
+		};
+
+		template<size_t I>
+		struct base_factors<lists::end_element,lists::end_element,I> {
+			static void fill(std::array<double,dims::dynamic_dimension::max_base_dims>&) {}
+		};
+
+		// symbols of a system's base units
+		template<class System, size_t I = 0>
+		struct base_symbols {
+			static void fill(std::array<const char*,dims::dynamic_dimension::max_base_dims>& out) {
+				out[I] = base_symbol<typename System::value>::value;
+				base_symbols<typename System::tail,I+1>::fill(out);
+			}
+		};
+
+		template<size_t I>
+		struct base_symbols<lists::end_element,I> {
+			static void fill(std::array<const char*,dims::dynamic_dimension::max_base_dims>&) {}
+		};
+
+		/*
+		 * Recursive descent parser over a string_view. Each routine returns the
+		 * plan in SI units for the part of the string it consumed.
+		 */
+		class unit_reader {
+		public:
+			explicit unit_reader(std::string_view s) :s(s), i(0) {}
+
+			unit_plan parse() {
+				skip_space();
+				if(i==s.size())
+					fail("empty unit string");
+				const unit_plan out = product();
+				if(i!=s.size())
+					fail("unexpected character");
+				return out;
+			}
+
+		private:
+			unit_plan product() {
+				unit_plan out = power();
+				for(;;) {
+					skip_space();
+					if(i==s.size() || s[i]==')')
+						return out;
+					if(s[i]=='/') {
+						++i;
+						const unit_plan rhs = power();
+						out.dimension = out.dimension/rhs.dimension;
+						out.factor /= rhs.factor;
+					}
+					else {
+						if(s[i]=='*' || s[i]=='.')
+							++i;
+						const unit_plan rhs = power();
+						out.dimension = out.dimension*rhs.dimension;
+						out.factor *= rhs.factor;
+					}
+				}
+			}
+
+			// a symbol, "1" or a bracketed product, with an optional power
+			unit_plan power() {
+				skip_space();
+				unit_plan out = {dims::dynamic_dimension(),1.0};
+				size_t base = dims::dynamic_dimension::max_base_dims;
+
+				if(i<s.size() && s[i]=='(') {
+					++i;
+					out = product();
+					if(i==s.size() || s[i]!=')')
+						fail("missing ')'");
+					++i;
+				}
+				else if(i<s.size() && s[i]=='1')
+					++i;
+				else {
+					const symbol& sym = read_symbol();
+					base = sym.base;
+					out.factor = sym.si;
+				}
+
+				if(i==s.size() || s[i]!='^') {
+					if(base<dims::dynamic_dimension::max_base_dims)
+						out.dimension = dims::dynamic_dimension((uint64_t)dims::dynamic_dimension::denominator << 8*base);
+					return out;
+				}
+				++i;
+
+				// the exponent, either an integer or a bracketed rational
+				int num, den = 1;
+				if(i<s.size() && s[i]=='(') {
+					++i;
+					num = read_int();
+					if(i<s.size() && s[i]=='/') {
+						++i;
+						den = read_int();
+					}
+					if(i==s.size() || s[i]!=')')
+						fail("missing ')' in exponent");
+					++i;
+				}
+				else
+					num = read_int();
+
+				if(den<=0 || (num*dims::dynamic_dimension::denominator)%den!=0)
+					fail("unsupported exponent");
+				const int scale = num*dims::dynamic_dimension::denominator/den;
+				if(scale<-128 || scale>127)
+					fail("exponent out of range");
+
+				if(base<dims::dynamic_dimension::max_base_dims)
+					out.dimension = dims::dynamic_dimension((uint64_t)(uint8_t)(int8_t)scale << 8*base);
+				else if(num%den==0)
+					out.dimension = pow(out.dimension,num/den);
+				else {
+					// (...)^(p/q) is only allowed when every exponent stays representable
+					uint64_t bits = 0;
+					for(size_t b=0; b<dims::dynamic_dimension::max_base_dims; ++b) {
+						const int lane = out.dimension.lane(b)*num;
+						if(lane%den!=0 || lane/den<-128 || lane/den>127)
+							fail("unsupported exponent");
+						bits |= (uint64_t)(uint8_t)(int8_t)(lane/den) << 8*b;
+					}
+					out.dimension = dims::dynamic_dimension(bits);
+				}
+				out.factor = std::pow(out.factor,(double)num/(double)den);
+				return out;
+			}
+
+			const symbol& read_symbol() {
+				const size_t start = i;
+				while(i<s.size() && ((s[i]>='a' && s[i]<='z') || (s[i]>='A' && s[i]<='Z')))
+					++i;
+				const std::string_view name = s.substr(start,i-start);
+				if(name.empty())
+					fail("expected a unit symbol");
+				for(const symbol& sym : symbols)
+					if(name==sym.name)
+						return sym;
+				fail("unknown unit symbol");
+				return symbols[0];
+			}
+
+			int read_int() {
+				bool negative = false;
+				if(i<s.size() && (s[i]=='-' || s[i]=='+'))
+					negative = s[i++]=='-';
+				if(i==s.size() || s[i]<'0' || s[i]>'9')
+					fail("expected an integer exponent");
+				int out = 0;
+				while(i<s.size() && s[i]>='0' && s[i]<='9' && out<1000)
+					out = 10*out + (s[i++]-'0');
+				return negative ? -out : out;
+			}
+
+			void skip_space() {
+				while(i<s.size() && s[i]==' ')
+					++i;
+			}
+
+			[[noreturn]] void fail(const char* what) const {
+				throw unit_parse_error(std::string("units: ") + what + " at position " + std::to_string(i) + " in '" + std::string(s) + "'");
+			}
+
+			std::string_view s;
+			size_t i;
+		};
+
+		inline uint64_t hash(std::string_view s) {
+			uint64_t h = 0xcbf29ce484222325ull; // FNV-1a
+			for(char c : s) {
+				h ^= (unsigned char)c;
+				h *= 0x100000001b3ull;
+			}
+			return h;
+		}
+
+	} // namespace parser
+
+	// parse a unit string, the factor converts into SI units
+	inline unit_plan parse_unit(std::string_view s) {
+		return parser::unit_reader(s).parse();
+	}
+
+	// parse a unit string, the factor converts into the target System
+	template<class System>
+	unit_plan parse_unit(std::string_view s) {
+		static const std::array<double,dims::dynamic_dimension::max_base_dims> bases = [] {
+			std::array<double,dims::dynamic_dimension::max_base_dims> out;
+			out.fill(1.0);
+			parser::base_factors<System>::fill(out);
+			return out;
+		}();
+
+		unit_plan out = parse_unit(s);
+		for(size_t b=0; b<bases.size(); ++b)
+			if(out.dimension.lane(b)!=0)
+				out.factor /= std::pow(bases[b],(double)out.dimension.lane(b)/dims::dynamic_dimension::denominator);
+		return out;
+	}
+
+	/*
+	 * Fixed size open addressing hash table of plans into System. Slots are
+	 * filled once and never removed, so readers need only an acquire load of
+	 * the slot state. Strings longer than key_capacity, or arriving when the
+	 * table is full, are parsed every time.
+	 */
+	template<class System, size_t Slots = 1024>
+	class plan_cache {
+		static_assert((Slots & (Slots-1))==0,"plan_cache size must be a power of two");
+
+	public:
+		static constexpr size_t key_capacity = 32;
+
+		plan_cache() = default;
+		plan_cache(const plan_cache&) = delete;
+		plan_cache& operator=(const plan_cache&) = delete;
+
+		unit_plan lookup(std::string_view s) {
+			if(s.size()>key_capacity)
+				return parse_unit<System>(s);
+
+			const uint64_t h = parser::hash(s);
+			for(size_t probe=0; probe<Slots; ++probe) {
+				slot& sl = slots[(h+probe) & (Slots-1)];
+				uint32_t state = sl.state.load(std::memory_order_acquire);
+
+				if(state==empty) {
+					const unit_plan plan = parse_unit<System>(s); // throws before claiming the slot
+					if(sl.state.compare_exchange_strong(state,writing,std::memory_order_acquire)) {
+						sl.hash = h;
+						sl.length = (uint32_t)s.size();
+						std::memcpy(sl.key,s.data(),s.size());
+						sl.plan = plan;
+						sl.state.store(ready,std::memory_order_release);
+						return plan;
+					}
+					// lost the race for this slot, state now holds its new value
+				}
+
+				if(state==writing)
+					return parse_unit<System>(s); // don't wait for another thread's insert
+				if(sl.hash==h && sl.length==s.size() && std::memcmp(sl.key,s.data(),s.size())==0)
+					return sl.plan;
+			}
+			return parse_unit<System>(s);
+		}
+
+	private:
+		enum : uint32_t { empty = 0, writing = 1, ready = 2 };
+
+		struct alignas(64) slot {
+			std::atomic<uint32_t> state{empty};
+			uint32_t length;
+			uint64_t hash;
+			unit_plan plan;
+			char key[key_capacity];
+		};
+
+		std::array<slot,Slots> slots;
+	};
+
+	// the shared cache for System
+	template<class System>
+	plan_cache<System>& default_plan_cache() {
+		static plan_cache<System> cache;
+		return cache;
+	}
+
+	// cached parse of a unit string into System
+	template<class System>
+	unit_plan plan_for(std::string_view s) {
+		return default_plan_cache<System>().lookup(s);
+	}
+
+	/*
+	 * The symbol for unit<Dim,System> in the grammar above, e.g. "kg*m/s^2"
+	 * or "g/cm^3". Dimensionless units are "1".
+	 */
+	template<class Dim, class System>
+	const std::string& unit_symbol() {
+		static const std::string symbol = [] {
+			std::array<const char*,dims::dynamic_dimension::max_base_dims> names = {};
+			parser::base_symbols<System>::fill(names);
+			const dims::dynamic_dimension d = dims::dimension_of<Dim>();
+
+			auto term = [&](size_t b, int lane) {
+				std::string out = names[b];
+				int num = lane, den = dims::dynamic_dimension::denominator;
+				while(den>1 && num%2==0 && den%2==0) { num /= 2; den /= 2; }
+				while(den>1 && num%3==0 && den%3==0) { num /= 3; den /= 3; }
+				if(den!=1)
+					out += "^(" + std::to_string(num) + "/" + std::to_string(den) + ")";
+				else if(num!=1)
+					out += "^" + std::to_string(num);
+				return out;
+			};
+
+			std::string out;
+			for(size_t b=0; b<names.size(); ++b)
+				if(d.lane(b)>0)
+					out += (out.empty() ? "" : "*") + term(b,d.lane(b));
+			if(out.empty())
+				out = "1";
+			for(size_t b=0; b<names.size(); ++b)
+				if(d.lane(b)<0)
+					out += "/" + term(b,-d.lane(b));
+			return out;
+		}();
+		return symbol;
+	}
+
+	/*
+	 * The factor converting values labelled s into unit<Dim,System>. Throws
+	 * dims::dimension_error if the string does not have dimensions Dim.
+	 */
+	template<class Dim, class System>
+	double factor_for(std::string_view s) {
+		const unit_plan p = plan_for<System>(s);
+		if(p.dimension!=dims::dimension_of<Dim>())
+			throw dims::dimension_error("units: '" + std::string(s) + "' has dimensions "
+										+ p.dimension.to_string(lists::list_length<Dim>::value) + " but "
+										+ dims::dimension_of<Dim>().to_string(lists::list_length<Dim>::value) + " was expected");
+		return p.factor;
+	}
+
+} // namespace units
+
+#endif /* UNIT_PARSER_HPP_ */
@@ -1,19 +1,32 @@
 #ifndef UNITS_HPP_
 #define UNITS_HPP_
 
+#include "dims.hpp"
+
+#include <cstdint>
+#include <ratio>
+#include <type_traits>
+
 namespace units
 {
 
 	/*
-	 * Unit systems - these are represented as static lists of types.
-	 * Some standard systems are predefined but the user can build their
-	 * own if they wish.
+	 * Unit systems - these are represented as static lists of types, one unit
+	 * per base dimension in the order used by dims (mass, length, time,
+	 * temperature, amount, current, luminous intensity and, with
+	 * DIMS_ANGLE_DIMENSION, angle). Some standard systems are predefined but
+	 * the user can build their own if they wish.
 	 */
 	namespace si
 	{
 		struct kg_t {};
 		struct m_t {};
 		struct s_t {};
+		struct K_t {};
+		struct mol_t {};
+		struct A_t {};
+		struct cd_t {};
+		struct rad_t {};
 	}
 
 	namespace cgs
@@ -26,50 +39,174 @@ namespace units
 	{
 		struct ft_t {};
 		struct lb_t {};
+		struct R_t {}; // degrees Rankine
 	}
 
-	using si_system = lists::static_list<si::kg_t,si::m_t,si::s_t>::elements;
-	using cgs_system = lists::static_list<cgs::g_t,cgs::cm_t,si::s_t>::elements;
-	using imperial_system = lists::static_list<imperial::lb_t,imperial::ft_t,si::s_t>::elements;
+	// a system from the units of the seven SI bases, with radians added for angle when enabled
+#if defined(DIMS_ANGLE_DIMENSION)
+	template<class... Us>
+	using make_system = typename lists::static_list<Us...,si::rad_t>::elements;
+#else
+	template<class... Us>
+	using make_system = typename lists::static_list<Us...>::elements;
+#endif
+
+	// the cgs system keeps the ampere rather than one of the cgs electromagnetic units
+	using si_system = make_system<si::kg_t,si::m_t,si::s_t,si::K_t,si::mol_t,si::A_t,si::cd_t>;
+	using cgs_system = make_system<cgs::g_t,cgs::cm_t,si::s_t,si::K_t,si::mol_t,si::A_t,si::cd_t>;
+	using imperial_system = make_system<imperial::lb_t,imperial::ft_t,si::s_t,imperial::R_t,si::mol_t,si::A_t,si::cd_t>;
+
+	static_assert(lists::list_length<si_system>::value==dims::base_dimensions,"Unit systems must have a unit for each base dimension");
+
+	/*
+	 * Names for unit systems, used when persisting units (see binary_io.hpp).
+	 * User defined systems must specialize this to be written to file.
+	 */
+	template<class System>
+	struct system_name;
+
+	template<> struct system_name<si_system> { static constexpr const char* value = "si"; };
+	template<> struct system_name<cgs_system> { static constexpr const char* value = "cgs"; };
+	template<> struct system_name<imperial_system> { static constexpr const char* value = "imperial"; };
+
+	/*
+	 * Symbols for the base units, used when formatting and parsing unit
+	 * strings (see unit_parser.hpp).
+	 */
+	template<class U>
+	struct base_symbol;
+
+	template<> struct base_symbol<si::kg_t> { static constexpr const char* value = "kg"; };
+	template<> struct base_symbol<si::m_t> { static constexpr const char* value = "m"; };
+	template<> struct base_symbol<si::s_t> { static constexpr const char* value = "s"; };
+	template<> struct base_symbol<cgs::g_t> { static constexpr const char* value = "g"; };
+	template<> struct base_symbol<cgs::cm_t> { static constexpr const char* value = "cm"; };
+	template<> struct base_symbol<imperial::ft_t> { static constexpr const char* value = "ft"; };
+	template<> struct base_symbol<imperial::lb_t> { static constexpr const char* value = "lb"; };
+	template<> struct base_symbol<si::K_t> { static constexpr const char* value = "K"; };
+	template<> struct base_symbol<imperial::R_t> { static constexpr const char* value = "degR"; };
+	template<> struct base_symbol<si::mol_t> { static constexpr const char* value = "mol"; };
+	template<> struct base_symbol<si::A_t> { static constexpr const char* value = "A"; };
+	template<> struct base_symbol<si::cd_t> { static constexpr const char* value = "cd"; };
+	template<> struct base_symbol<si::rad_t> { static constexpr const char* value = "rad"; };
 
 	/*
 	 * Conversion factors for fundamental units. Returns a unit originally of value 1.0 in
 	 * unit U2 converted to U1. This is done as a static member of a template struct to
 	 * allow us to partially specialize for the case where the units are the same.
+	 *
+	 * Converters whose factor is rational also expose it exactly as a std::ratio
+	 * named 'ratio', which lets compound factors be computed exactly.
 	 */
 
-	template<class U1, class U2>
-	struct convert {
+	template<class C, class = void>
+	struct has_ratio : std::false_type {};
+
+	template<class C>
+	struct has_ratio<C,typename std::conditional<true,void,typename C::ratio>::type> : std::true_type {};
+
+	// a converter with an exact rational factor
+	template<class R>
+	struct ratio_convert {
+		using ratio = R;
 		static constexpr double factor() {
-			return 1.0/convert<U2,U1>::factor(); // allows us to define conversions in one direction only but have it work for both
+			return (double)R::num/(double)R::den;
 		}
 	};
 
-	template<> struct convert<si::kg_t,cgs::g_t> { static constexpr double factor() { return 0.001; } };
-	template<> struct convert<si::m_t,cgs::cm_t> { static constexpr double factor() { return 0.01; } };
-	template<> struct convert<si::kg_t,imperial::lb_t> { static constexpr double factor() { return 0.453592; } };
-	template<> struct convert<si::m_t,imperial::ft_t> { static constexpr double factor() { return 0.3048; } };
-	template<> struct convert<cgs::g_t,imperial::lb_t> { static constexpr double factor() { return convert<cgs::g_t,si::kg_t>::factor()*convert<si::kg_t,imperial::lb_t>::factor(); } };
+	// the reverse of the converter C
+	template<class C, bool Exact = has_ratio<C>::value>
+	struct reverse_convert {
+		static constexpr double factor() {
+			return 1.0/C::factor();
+		}
+	};
+
+	template<class C>
+	struct reverse_convert<C,true> : ratio_convert<std::ratio_divide<std::ratio<1>,typename C::ratio>> {};
+
+	template<class U1, class U2>
+	struct convert : reverse_convert<convert<U2,U1>> {}; // allows us to define conversions in one direction only but have it work for both
+
+	template<> struct convert<si::kg_t,cgs::g_t> : ratio_convert<std::ratio<1,1000>> {};
+	template<> struct convert<si::m_t,cgs::cm_t> : ratio_convert<std::ratio<1,100>> {};
+	template<> struct convert<si::kg_t,imperial::lb_t> : ratio_convert<std::ratio<453592,1000000>> {};
+	template<> struct convert<si::m_t,imperial::ft_t> : ratio_convert<std::ratio<3048,10000>> {};
+	template<> struct convert<cgs::g_t,imperial::lb_t> : ratio_convert<std::ratio_multiply<convert<cgs::g_t,si::kg_t>::ratio,convert<si::kg_t,imperial::lb_t>::ratio>> {};
+	template<> struct convert<cgs::cm_t,imperial::ft_t> : ratio_convert<std::ratio_multiply<convert<cgs::cm_t,si::m_t>::ratio,convert<si::m_t,imperial::ft_t>::ratio>> {};
+	template<> struct convert<si::K_t,imperial::R_t> : ratio_convert<std::ratio<5,9>> {}; // temperature differences, no offset
+
+	template<class U1> struct convert<U1,U1> : ratio_convert<std::ratio<1>> {};
+
+	/*
+	 * Compile time arithmetic used to combine the fundamental factors.
+	 */
+
+	// ipow and iroot are shared with dims.hpp
+	using dims::ipow;
+	using dims::iroot;
+
+	/*
+	 * Factor for a single base unit raised to the rational power R. For exact
+	 * converters and integer powers the numerator and denominator are kept
+	 * separately so the compound factor is rounded only once.
+	 */
+	template<class C, class R, bool Exact = has_ratio<C>::value && R::den==1>
+	struct power_factor {
+		static constexpr long double num = R::num>=0 ? ipow(C::ratio::num,R::num) : ipow(C::ratio::den,-R::num);
+		static constexpr long double den = R::num>=0 ? ipow(C::ratio::den,R::num) : ipow(C::ratio::num,-R::num);
+		static constexpr long double inexact = 1.0L;
+	};
 
-	template<class U1> struct convert<U1,U1> { static constexpr double factor() { return 1.0; } };
+	template<class C, class R>
+	struct power_factor<C,R,false> {
+		static constexpr long double num = 1.0L;
+		static constexpr long double den = 1.0L;
+		static constexpr long double inexact = iroot(ipow(C::factor(),R::num),R::den);
+	};
 
 	/*
-	 * A recursive function which computes compound conversion factors from
-	 * fundamental conversion factors and the rational powers of a quantity's
-	 * dimensions.
+	 * Recursively combines the fundamental conversion factors using the
+	 * rational powers of a quantity's dimensions. The result is a single
+	 * compile time constant.
 	 */
 	template<class Dim, class System1, class System2>
-	constexpr double conversion_factor() {
-		using ratpow = typename Dim::value;
-		return pow(convert<typename System1::value,typename System2::value>::factor(),(double)ratpow::num/(double)ratpow::den)
-				*conversion_factor<typename Dim::tail,typename System1::tail,typename System2::tail>();
-	}
+	struct conversion {
+		using head = power_factor<convert<typename System1::value,typename System2::value>,typename Dim::value>;
+		using tail = conversion<typename Dim::tail,typename System1::tail,typename System2::tail>;
+
+		static constexpr long double num = head::num*tail::num;
+		static constexpr long double den = head::den*tail::den;
+		static constexpr long double inexact = head::inexact*tail::inexact;
+
+		// a single division when the numerator and denominator are exact doubles
+		static constexpr double factor = (num<=9007199254740992.0L && den<=9007199254740992.0L)
+		                                 ? (double)((double)num/(double)den*(double)inexact)
+		                                 : (double)(num/den*inexact);
+	};
 
 	template<>
-	constexpr double conversion_factor<lists::end_element,lists::end_element,lists::end_element>() {
-		return 1.0;
+	struct conversion<lists::end_element,lists::end_element,lists::end_element> {
+		static constexpr long double num = 1.0L;
+		static constexpr long double den = 1.0L;
+		static constexpr long double inexact = 1.0L;
+		static constexpr double factor = 1.0;
+	};
+
+	template<class Dim, class System1, class System2>
+	constexpr double conversion_factor() {
+		return conversion<Dim,System1,System2>::factor;
 	}
 
+	static_assert(conversion_factor<dims::area,si_system,cgs_system>()==1e-4,"cm^2 -> m^2 should be exact");
+	static_assert(conversion_factor<dims::volume,cgs_system,si_system>()==1e6,"m^3 -> cm^3 should be exact");
+	static_assert(conversion_factor<dims::length,cgs_system,imperial_system>()==30.48,"ft -> cm should be a single rounding");
+	static_assert(conversion_factor<dims::sqrt_Dimension<dims::length>::result,cgs_system,si_system>()==10.0,"fractional powers should be computed at compile time");
+
+	// products of units whose conversion is deferred (see unit_expr.hpp)
+	template<class Dim, class Terms, class T>
+	class unit_product;
+
 	/*
 	 * Class for representing quantities with units as well as dimensions.
 	 */
@@ -84,10 +221,18 @@ namespace units
 
 		// create a unit from a quantity with different units (but same dimensions)
 		template<class System2>
-		constexpr unit(const unit<Dim,System2,T>& u) :val(u.val*conversion_factor<Dim,System,System2>()) {}
+		constexpr unit(const unit<Dim,System2,T>& u) :val(u.val*conversion<Dim,System,System2>::factor) {}
+
+		// evaluate a deferred product, applying its combined conversion factor once
+		template<class Dim2, class Terms, class T2>
+		constexpr unit(const unit_product<Dim2,Terms,T2>& p) :val(p.template value_in<System>()) {
+			static_assert(std::is_same<Dim,Dim2>::value,"Cannot create unit from a product with different dimensions.");
+		}
 
 		// create a unit from another quantity with the same units - no conversion necessary
-		constexpr unit(const this_type& u) :val(u.val) {}
+		constexpr unit(const this_type& u) = default;
+
+		constexpr this_type& operator=(const this_type& u) = default;
 
 		/*
 		 * Multiply units - produces a unit object with the correct dimensions
@@ -99,7 +244,7 @@ namespace units
 		using mult_type = unit<typename dims::mult_Dimension<Dim,Dim2>::result,System,decltype(std::declval<T>()*std::declval<T2>())>;
 
 		template<class Dim2, class System2, class T2>
-		mult_type<Dim2,System2,T2> constexpr operator*(const unit<Dim2,System2,T2>& u){
+		mult_type<Dim2,System2,T2> constexpr operator*(const unit<Dim2,System2,T2>& u) const {
 			return mult_type<Dim2,System2,T2>
 							(
 								unit<Dim2,System,T2>(u) // convert u to the correct system
@@ -112,10 +257,50 @@ namespace units
 		using div_type = unit<typename dims::mult_Dimension<Dim,typename dims::inv_Dimension<Dim2>::result>::result,System,decltype(std::declval<T>()/std::declval<T2>())>;
 
 		template<class Dim2, class System2, class T2>
-		div_type<Dim2,System2,T2> constexpr operator/(const unit<Dim2,System2,T2>& u){
+		div_type<Dim2,System2,T2> constexpr operator/(const unit<Dim2,System2,T2>& u) const {
 			return div_type<Dim2,System2,T2>(val / unit<Dim2,System,T2>(u).val);
 		}
 
+		/*
+		 * Add or subtract units - the dimensions must match and the right hand
+		 * side is converted to the system of the left hand side.
+		 */
+
+		template<class System2, class T2>
+		using add_type = unit<Dim,System,decltype(std::declval<T>()+std::declval<T2>())>;
+
+		template<class System2, class T2>
+		add_type<System2,T2> constexpr operator+(const unit<Dim,System2,T2>& u) const {
+			return add_type<System2,T2>(val + unit<Dim,System,T2>(u).val);
+		}
+
+		template<class System2, class T2>
+		add_type<System2,T2> constexpr operator-(const unit<Dim,System2,T2>& u) const {
+			return add_type<System2,T2>(val - unit<Dim,System,T2>(u).val);
+		}
+
+		template<class System2, class T2>
+		constexpr this_type& operator+=(const unit<Dim,System2,T2>& u) {
+			val += unit<Dim,System,T2>(u).val;
+			return *this;
+		}
+
+		template<class System2, class T2>
+		constexpr this_type& operator-=(const unit<Dim,System2,T2>& u) {
+			val -= unit<Dim,System,T2>(u).val;
+			return *this;
+		}
+
+		// square root - the result stays in the same system
+		friend constexpr unit<typename dims::sqrt_Dimension<Dim>::result,System,T> sqrt(const this_type& u) {
+			return unit<typename dims::sqrt_Dimension<Dim>::result,System,T>(dims::constexpr_sqrt(u.val));
+		}
+
+		// discard units and dimensional saftey and get the raw value
+		friend constexpr T discard_units(const this_type& u) {
+			return u.val;
+		}
+
 		// create a unit from a raw data type - declaration
 		template<class Dim2, class System2, class T2>
 		friend constexpr unit<Dim2,System2,T2> operator*(T2 t,const unit<Dim2,System2,T2>& u);
@@ -130,27 +315,27 @@ namespace units
 
 	// create a unit from a raw data type - defintion
 	template<class Dim2, class System2, class T2>
-	unit<Dim2,System2,T2> constexpr operator*(T2 t,const unit<Dim2,System2,T2>& u){
+	unit<Dim2,System2,T2> constexpr operator*(T2 t,const unit<Dim2,System2,T2>&){
 		return unit<Dim2,System2,T2>(t); // utilise friendship
 	}
 
 	/*
 	 * Unit objects
 	 */
-	unit<dims::length,si_system> meter;
-	unit<dims::mass,si_system> kilogram;
-	unit<dims::time,si_system> second;
-	unit<dims::length,cgs_system> cm;
-	unit<dims::mass,cgs_system> gram;
+	inline constexpr unit<dims::length,si_system> meter;
+	inline constexpr unit<dims::mass,si_system> kilogram;
+	inline constexpr unit<dims::time,si_system> second;
+	inline constexpr unit<dims::length,cgs_system> cm;
+	inline constexpr unit<dims::mass,cgs_system> gram;
 
 	/*
 	 * Literal definitions for easy unit creation
 	 */
-	constexpr decltype(meter)		operator"" _m (long double d) { return ((double)d)*meter; }
-	constexpr decltype(kilogram)	operator"" _kg(long double d) { return ((double)d)*kilogram; }
-	constexpr decltype(second)		operator"" _s (long double d) { return ((double)d)*second; }
-	constexpr decltype(cm)			operator"" _cm(long double d) { return ((double)d)*cm; }
-	constexpr decltype(gram)		operator"" _g (long double d) { return ((double)d)*gram; }
+	constexpr std::decay_t<decltype(meter)>	operator"" _m (long double d) { return ((double)d)*meter; }
+	constexpr std::decay_t<decltype(kilogram)>	operator"" _kg(long double d) { return ((double)d)*kilogram; }
+	constexpr std::decay_t<decltype(second)>	operator"" _s (long double d) { return ((double)d)*second; }
+	constexpr std::decay_t<decltype(cm)>	operator"" _cm(long double d) { return ((double)d)*cm; }
+	constexpr std::decay_t<decltype(gram)>	operator"" _g (long double d) { return ((double)d)*gram; }
 	constexpr decltype(kilogram*meter/(second*second))
 									operator"" _kg_m_per_s_squared(long double d) { return ((double)d)*meter*kilogram/(second*second); }
 
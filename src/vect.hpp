@@ -4,12 +4,18 @@
 #include <iostream>
 #include <memory>
 #include <array>
+#include <cmath>
+#include <type_traits>
 
-template<size_t N, typename T>
+#include "instrument.hpp"
+#include "vect_simd.hpp"
+
+template<size_t N, typename T=double>
 class nvect {
 
 	static_assert(N>0,"Cannot create nvect<size_t N, class T> with N<1");
 	using this_type = nvect<N,T>;
+	using kernels = nvect_kernels<N,T>;
 
 	template<size_t M, class U> friend class nvect;
 
@@ -26,14 +32,10 @@ public:
 	 * Non-trivial constructors
 	 */
 
-	// stop the variadic template constructor hiding copy constructor for non-const objects
-	nvect(this_type& v)
-	:nvect<N,T>(const_cast<const this_type&>(v))
-	{
-	}
-
-	// init each component to a different value
-	template<typename U, typename... Us>
+	// init each component to a different value (disabled for a single nvect argument so
+	// it does not hide the trivial copy constructor for non-const objects)
+	template<typename U, typename... Us, typename = typename std::enable_if<
+		sizeof...(Us)!=0 || !std::is_same<typename std::decay<U>::type,this_type>::value>::type>
 	nvect(U&& u, Us&&... us) :values{std::forward<U>(u),std::forward<Us>(us)...} {
 		static_assert(sizeof...(Us)==N-1,"Not enough args supplied!");
 	}
@@ -47,7 +49,18 @@ public:
 		return values[i];
 	}
 
+	/*
+	 * Operations between vectors of the same type go through nvect_kernels
+	 * (see vect_simd.hpp), the templates below handle mixed types.
+	 */
+
 	// element-wise multiplication
+	this_type operator* (const this_type& vect) const {
+		this_type out;
+		DIMS_OBSERVE_ASSIGN(mul,out,kernels::mul(out.values,values,vect.values),(*this,vect),void);
+		return out;
+	}
+
 	template<typename U>
 	nvect<N,decltype(std::declval<T>()*std::declval<U>())>
 	operator* (const nvect<N,U>& vect) const {
@@ -58,6 +71,12 @@ public:
 	}
 
 	// multiplication by a scalar
+	this_type operator* (T scalar) const {
+		this_type out;
+		DIMS_OBSERVE_ASSIGN(mul,out,kernels::scale(out.values,values,scalar),(*this,scalar),void);
+		return out;
+	}
+
 	template<typename U>
 	nvect<N,decltype(std::declval<T>()*std::declval<U>())>
 	operator* (U scalar) const {
@@ -71,10 +90,11 @@ public:
 	friend nvect<M,decltype(std::declval<V>()*std::declval<U>())> operator*(U scalar, const nvect<M,V>& vect);
 
 	T sum() const {
-		T out; // default initialise in case T is some non-primitive type
-		for(size_t i=0; i<N; ++i)
-			out += values[i];
-		return out;
+		return kernels::sum(values);
+	}
+
+	T dot(const this_type& vect) const {
+		return DIMS_OBSERVE(dot,kernels::dot(values,vect.values),(*this,vect),void);
 	}
 
 	template<typename U>
@@ -88,6 +108,12 @@ public:
 	}
 
 	// division by a scalar
+	this_type operator/ (T scalar) const {
+		this_type out;
+		DIMS_OBSERVE_ASSIGN(div,out,kernels::divide(out.values,values,scalar),(*this,scalar),void);
+		return out;
+	}
+
 	template<typename U>
 	nvect<N,decltype(std::declval<T>()/std::declval<U>())>
 	operator/ (U scalar) const {
@@ -98,6 +124,12 @@ public:
 	}
 
 	// element wise division
+	this_type operator/ (const this_type& vect) const {
+		this_type out;
+		DIMS_OBSERVE_ASSIGN(div,out,kernels::div(out.values,values,vect.values),(*this,vect),void);
+		return out;
+	}
+
 	template<typename U>
 	nvect<N,decltype(std::declval<T>()/std::declval<U>())>
 	operator/ (const nvect<N,U>& vect) {
@@ -110,52 +142,44 @@ public:
 	// addition and subtraction
 	nvect operator + (const this_type& vect) const {
 		this_type out;
-		for(size_t i=0;i<N;++i)
-			out.values[i] = values[i] + vect.values[i];
+		DIMS_OBSERVE_ASSIGN(add,out,kernels::add(out.values,values,vect.values),(*this,vect),void);
 		return out;
 	}
 
 	nvect operator - (const this_type& vect) const {
 		this_type out;
-		for(size_t i=0;i<N;++i)
-			out.values[i] = values[i] - vect.values[i];
+		DIMS_OBSERVE_ASSIGN(sub,out,kernels::sub(out.values,values,vect.values),(*this,vect),void);
 		return out;
 	}
 
 	// assigment operators
 	this_type& operator+= (const this_type& vect) {
-		for(size_t i=0;i<N;++i)
-			values[i] += vect.values[i];
+		DIMS_OBSERVE_ASSIGN(add,*this,kernels::add(values,values,vect.values),(*this,vect),void);
 		return *this;
 	}
 
 	this_type& operator-= (const this_type& vect) {
-		for(size_t i=0;i<N;++i)
-			values[i] -= vect.values[i];
+		DIMS_OBSERVE_ASSIGN(sub,*this,kernels::sub(values,values,vect.values),(*this,vect),void);
 		return *this;
 	}
 
 	this_type& operator*= (const this_type& vect) {
-		for(size_t i=0;i<N;++i)
-			values[i] *= vect.values[i];
+		DIMS_OBSERVE_ASSIGN(mul,*this,kernels::mul(values,values,vect.values),(*this,vect),void);
 		return *this;
 	}
 
 	this_type& operator/= (const this_type& vect) {
-		for(size_t i=0;i<N;++i)
-			values[i] /= vect.values[i];
+		DIMS_OBSERVE_ASSIGN(div,*this,kernels::div(values,values,vect.values),(*this,vect),void);
 		return *this;
 	}
 
 	this_type& operator*= (T scalar) {
-		for(size_t i=0;i<N;++i)
-			values[i] *= scalar;
+		DIMS_OBSERVE_ASSIGN(mul,*this,kernels::scale(values,values,scalar),(*this,scalar),void);
 		return *this;
 	}
 
 	this_type& operator/= (T scalar) {
-		for(size_t i=0;i<N;++i)
-			values[i] /= scalar;
+		DIMS_OBSERVE_ASSIGN(div,*this,kernels::divide(values,values,scalar),(*this,scalar),void);
 		return *this;
 	}
 
@@ -174,15 +198,14 @@ public:
 		return out;
 	}
 
+	// the components are contiguous so are written/read in a single call
 	void serialize(std::ostream& out) const {
-		for(size_t i=0;i<N;++i)
-			out.write((char*)(&values[i]),sizeof(T));
+		out.write((const char*)values,N*sizeof(T));
 	}
 
 	void deserialize(std::istream& in)
 	{
-		for(size_t i=0;i<N;++i)
-			in.read((char*)(&values[i]),sizeof(T));
+		in.read((char*)values,N*sizeof(T));
 	}
 
 	// make a vector where each component is the same value
@@ -200,7 +223,8 @@ public:
 	}
 
 private:
-	T values[N];
+	// may be padded and over-aligned for SIMD, only the first N are components
+	alignas(nvect_layout<N,T>::alignment) T values[nvect_layout<N,T>::padded];
 };
 
 template<size_t M, typename U, typename V>
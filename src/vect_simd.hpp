@@ -0,0 +1,225 @@
+#ifndef VECT_SIMD_HPP_
+#define VECT_SIMD_HPP_
+
+#include <cstddef>
+
+/*
+ * Storage layout and arithmetic kernels for nvect<N,T>.
+ *
+ * By default every nvect uses the portable scalar loops below and has
+ * exactly the same layout as T[N]. Defining NVECT_SIMD before including
+ * vect.hpp switches the common sizes over to aligned storage and register
+ * kernels, chosen at compile time from the instruction sets the compiler is
+ * targeting (e.g. -mavx2): N=2,3,4 of float and N=2 of double with SSE2,
+ * also N=8 of float and N=3,4 of double with AVX, and also N=8 of double
+ * with AVX-512. Other sizes keep the scalar loops. Sizes which do not fill a
+ * register (N=2 of float, N=3) are padded to the register width, so e.g.
+ * sizeof(nvect<3,double>) becomes 32 with AVX. All translation units
+ * must therefore agree on NVECT_SIMD and the target flags.
+ */
+
+#if defined(NVECT_SIMD) && (defined(__SSE2__) || defined(__AVX__) || defined(__AVX512F__))
+#include <immintrin.h>
+#endif
+
+// number of stored lanes and alignment of nvect<N,T>
+template<size_t N, typename T>
+struct nvect_layout {
+	static constexpr size_t padded = N;
+	static constexpr size_t alignment = alignof(T);
+};
+
+/*
+ * Portable kernels. Arguments point to 'nvect_layout<N,T>::padded' elements
+ * and out may alias the inputs.
+ */
+template<size_t N, typename T>
+struct nvect_kernels {
+
+	static void add(T* out, const T* a, const T* b) {
+		for(size_t i=0; i<N; ++i)
+			out[i] = a[i] + b[i];
+	}
+
+	static void sub(T* out, const T* a, const T* b) {
+		for(size_t i=0; i<N; ++i)
+			out[i] = a[i] - b[i];
+	}
+
+	static void mul(T* out, const T* a, const T* b) {
+		for(size_t i=0; i<N; ++i)
+			out[i] = a[i] * b[i];
+	}
+
+	static void div(T* out, const T* a, const T* b) {
+		for(size_t i=0; i<N; ++i)
+			out[i] = a[i] / b[i];
+	}
+
+	static void scale(T* out, const T* a, T s) {
+		for(size_t i=0; i<N; ++i)
+			out[i] = a[i] * s;
+	}
+
+	static void divide(T* out, const T* a, T s) {
+		for(size_t i=0; i<N; ++i)
+			out[i] = a[i] / s;
+	}
+
+	static T sum(const T* a) {
+		T out = T();
+		for(size_t i=0; i<N; ++i)
+			out += a[i];
+		return out;
+	}
+
+	static T dot(const T* a, const T* b) {
+		T out = T();
+		for(size_t i=0; i<N; ++i)
+			out += a[i]*b[i];
+		return out;
+	}
+};
+
+#if defined(NVECT_SIMD)
+
+namespace simd {
+
+	/*
+	 * Kernels for a vector of N elements held in a single register. The ISA
+	 * struct supplies the register type and the intrinsics. Lanes beyond N
+	 * (padding) take part in element-wise operations but not in reductions.
+	 */
+	template<size_t N, typename T, class ISA>
+	struct register_kernels {
+
+		using reg = typename ISA::reg;
+
+		static void add(T* out, const T* a, const T* b) { ISA::store(out,ISA::add(ISA::load(a),ISA::load(b))); }
+		static void sub(T* out, const T* a, const T* b) { ISA::store(out,ISA::sub(ISA::load(a),ISA::load(b))); }
+		static void mul(T* out, const T* a, const T* b) { ISA::store(out,ISA::mul(ISA::load(a),ISA::load(b))); }
+		static void div(T* out, const T* a, const T* b) { ISA::store(out,ISA::div(ISA::load(a),ISA::load(b))); }
+		static void scale(T* out, const T* a, T s) { ISA::store(out,ISA::mul(ISA::load(a),ISA::set1(s))); }
+		static void divide(T* out, const T* a, T s) { ISA::store(out,ISA::div(ISA::load(a),ISA::set1(s))); }
+
+		static T sum(const T* a) {
+			return hsum(ISA::load(a));
+		}
+
+		static T dot(const T* a, const T* b) {
+			return hsum(ISA::mul(ISA::load(a),ISA::load(b)));
+		}
+
+	private:
+		// horizontal sum of the first N lanes
+		static T hsum(reg r) {
+			alignas(ISA::width*sizeof(T)) T lanes[ISA::width];
+			ISA::store(lanes,r);
+			T out = lanes[0];
+			for(size_t i=1; i<N; ++i)
+				out += lanes[i];
+			return out;
+		}
+	};
+
+#if defined(__SSE2__)
+	struct sse_ps {
+		using reg = __m128;
+		static constexpr size_t width = 4;
+		static reg load(const float* p) { return _mm_load_ps(p); }
+		static void store(float* p, reg r) { _mm_store_ps(p,r); }
+		static reg set1(float s) { return _mm_set1_ps(s); }
+		static reg add(reg a, reg b) { return _mm_add_ps(a,b); }
+		static reg sub(reg a, reg b) { return _mm_sub_ps(a,b); }
+		static reg mul(reg a, reg b) { return _mm_mul_ps(a,b); }
+		static reg div(reg a, reg b) { return _mm_div_ps(a,b); }
+	};
+
+	struct sse_pd {
+		using reg = __m128d;
+		static constexpr size_t width = 2;
+		static reg load(const double* p) { return _mm_load_pd(p); }
+		static void store(double* p, reg r) { _mm_store_pd(p,r); }
+		static reg set1(double s) { return _mm_set1_pd(s); }
+		static reg add(reg a, reg b) { return _mm_add_pd(a,b); }
+		static reg sub(reg a, reg b) { return _mm_sub_pd(a,b); }
+		static reg mul(reg a, reg b) { return _mm_mul_pd(a,b); }
+		static reg div(reg a, reg b) { return _mm_div_pd(a,b); }
+	};
+#endif
+
+#if defined(__AVX__)
+	struct avx_ps {
+		using reg = __m256;
+		static constexpr size_t width = 8;
+		static reg load(const float* p) { return _mm256_load_ps(p); }
+		static void store(float* p, reg r) { _mm256_store_ps(p,r); }
+		static reg set1(float s) { return _mm256_set1_ps(s); }
+		static reg add(reg a, reg b) { return _mm256_add_ps(a,b); }
+		static reg sub(reg a, reg b) { return _mm256_sub_ps(a,b); }
+		static reg mul(reg a, reg b) { return _mm256_mul_ps(a,b); }
+		static reg div(reg a, reg b) { return _mm256_div_ps(a,b); }
+	};
+
+	struct avx_pd {
+		using reg = __m256d;
+		static constexpr size_t width = 4;
+		static reg load(const double* p) { return _mm256_load_pd(p); }
+		static void store(double* p, reg r) { _mm256_store_pd(p,r); }
+		static reg set1(double s) { return _mm256_set1_pd(s); }
+		static reg add(reg a, reg b) { return _mm256_add_pd(a,b); }
+		static reg sub(reg a, reg b) { return _mm256_sub_pd(a,b); }
+		static reg mul(reg a, reg b) { return _mm256_mul_pd(a,b); }
+		static reg div(reg a, reg b) { return _mm256_div_pd(a,b); }
+	};
+#endif
+
+#if defined(__AVX512F__)
+	struct avx512_pd {
+		using reg = __m512d;
+		static constexpr size_t width = 8;
+		static reg load(const double* p) { return _mm512_load_pd(p); }
+		static void store(double* p, reg r) { _mm512_store_pd(p,r); }
+		static reg set1(double s) { return _mm512_set1_pd(s); }
+		static reg add(reg a, reg b) { return _mm512_add_pd(a,b); }
+		static reg sub(reg a, reg b) { return _mm512_sub_pd(a,b); }
+		static reg mul(reg a, reg b) { return _mm512_mul_pd(a,b); }
+		static reg div(reg a, reg b) { return _mm512_div_pd(a,b); }
+	};
+#endif
+
+}; // namespace simd
+
+// use the register kernels for nvect<N,T>, padding it out to a full register
+#define NVECT_SIMD_IMPL(n,type,isa) \
+	template<> struct nvect_layout<n,type> { \
+		static constexpr size_t padded = simd::isa::width; \
+		static constexpr size_t alignment = simd::isa::width*sizeof(type); \
+	}; \
+	template<> struct nvect_kernels<n,type> : simd::register_kernels<n,type,simd::isa> {};
+
+#if defined(__SSE2__)
+	NVECT_SIMD_IMPL(2,float,sse_ps)
+	NVECT_SIMD_IMPL(2,double,sse_pd)
+#endif
+
+#if defined(__AVX__)
+	NVECT_SIMD_IMPL(3,float,sse_ps)
+	NVECT_SIMD_IMPL(4,float,sse_ps)
+	NVECT_SIMD_IMPL(8,float,avx_ps)
+	NVECT_SIMD_IMPL(3,double,avx_pd)
+	NVECT_SIMD_IMPL(4,double,avx_pd)
+#elif defined(__SSE2__)
+	NVECT_SIMD_IMPL(3,float,sse_ps)
+	NVECT_SIMD_IMPL(4,float,sse_ps)
+#endif
+
+#if defined(__AVX512F__)
+	NVECT_SIMD_IMPL(8,double,avx512_pd)
+#endif
+
+#undef NVECT_SIMD_IMPL
+
+#endif /* NVECT_SIMD */
+
+#endif /* VECT_SIMD_HPP_ */